@@ -24,7 +24,21 @@ SOURCES += \
 HEADERS += \
     mainwindow/mainwindow.h \
     multi_select_file_dialog/include/multi_select_file_dialog.h \
+    spm_process/include/spm_decode.hpp \
+    spm_process/include/spm_file.hpp \
+    spm_process/include/spm_flatten.hpp \
+    spm_process/include/spm_folder_index.hpp \
+    spm_process/include/spm_grid_stitcher.hpp \
+    spm_process/include/spm_header.hpp \
+    spm_process/include/spm_height_map.hpp \
+    spm_process/include/spm_npy.hpp \
+    spm_process/include/spm_number.hpp \
+    spm_process/include/spm_parallel.hpp \
+    spm_process/include/spm_prefetch.hpp \
+    spm_process/include/spm_schema.hpp \
     spm_process/include/spm_stitching.hpp \
+    spm_process/include/spm_tile_cache.hpp \
+    spm_process/include/spm_tile_store.hpp \
 
 FORMS += \
     mainwindow/mainwindow.ui
@@ -8,6 +8,10 @@ MainWindow::MainWindow(QWidget *parent)
           m_path_select(new MultiSelectFileDialog) {
     ui->setupUi(this);
     this->setWindowIcon(QIcon(":/ui/resource/icon.ico"));
+
+    // 已拉平图块的磁盘缓存，重复打开相同文件时跳过解码与拉平
+    QString cache_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tiles";
+    m_tile_cache = std::make_shared<SpmTileCache>(cache_dir.toStdString());
 }
 
 MainWindow::~MainWindow() {
@@ -28,33 +32,39 @@ void MainWindow::on_btn_add_clicked() {
         QStringList paths = m_path_select->selectedFiles();
 
         if (!paths.isEmpty()) {
+            std::string image_type = ui->comboBox_spm_type->currentText().toStdString();
+
+            // 只读取文件头，像素数据在预览或保存时才解码; 各文件并行读取，以重叠网络共享等慢速存储的访问延迟
+            std::vector<std::string> path_list(paths.size());
             for (int i = 0; i < paths.size(); i++) {
                 slashLeftToRight(paths[i]);
+                path_list[i] = paths[i].toStdString();
+            }
+
+            std::vector<SpmProbeInfo> probe_info_list(path_list.size());
+            std::vector<char> probe_status_list(path_list.size(), 0);
+            SpmParallel::forEachIndex(path_list.size(), 0, [&](size_t i) {
+                SpmReader spm(path_list[i], image_type);
+                probe_status_list[i] = spm.probe(probe_info_list[i]) && probe_info_list[i].hasChannel(image_type);
+            });
 
-                SpmReader spm(paths[i].toStdString(), ui->comboBox_spm_type->currentText().toStdString());
-                if (!spm.readSpm()) {
+            for (int i = 0; i < paths.size(); i++) {
+                if (!probe_status_list[i]) {
                     std::cout << "Reading spm file error!" << std::endl;
                     printLog("Reading spm file \"" + paths[i] + "\" error!", "error");
                     continue;
                 }
 
-                auto &spm_image = spm.getImageSingle();
-                SpmAlgorithm::flattenFirst(spm_image);
-                cv::Mat image = SpmAlgorithm::spmImageToImage(spm_image);
-
                 // add spm offset nm
-                m_spm_offset_nm_list.emplace_back(std::pair<int, int>{spm.getXOffsetNM(), spm.getYOffsetNM()});
-
-                // add image flatten filst
-                m_image_f1_list.emplace_back(image);
-
-                // add spm reader
-                m_spm_reader_list.emplace_back(std::move(spm));
+                m_spm_offset_nm_list.emplace_back(std::pair<int, int>{probe_info_list[i].x_offset_nm,
+                                                                      probe_info_list[i].y_offset_nm});
 
                 // add spm path
-                m_spm_path_list.emplace_back(paths[i].toStdString());
+                m_spm_path_list.emplace_back(path_list[i]);
             }
 
+            clearSpmImages();
+
             updateListWidgetFiles();
             printLog("Adding files completed!", "info");
         }
@@ -67,8 +77,13 @@ void MainWindow::on_btn_sub_clicked() {
     if (current_row < 0) return;
 
     m_spm_path_list.erase(m_spm_path_list.begin() + current_row);
+    m_spm_offset_nm_list.erase(m_spm_offset_nm_list.begin() + current_row);
 
-    reloadSpmReaderList();
+    // 已读取的图像随文件列表一起移除，无需重新读取
+    if (!m_spm_reader_list.empty()) {
+        m_spm_reader_list.erase(m_spm_reader_list.begin() + current_row);
+        m_tile_store.erase(current_row);
+    }
 
     updateListWidgetFiles();
 }
@@ -79,8 +94,8 @@ void MainWindow::on_btn_up_clicked() {
     if (current_row <= 0) return;
 
     std::swap(m_spm_path_list[current_row], m_spm_path_list[current_row - 1]);
-
-    reloadSpmReaderList();
+    std::swap(m_spm_offset_nm_list[current_row], m_spm_offset_nm_list[current_row - 1]);
+    swapSpmImages(current_row, current_row - 1);
 
     updateListWidgetFiles();
 }
@@ -91,16 +106,23 @@ void MainWindow::on_btn_down_clicked() {
     if (current_row < 0 || current_row == ui->listWidget_files->count() - 1) return;
 
     std::swap(m_spm_path_list[current_row], m_spm_path_list[current_row + 1]);
-
-    reloadSpmReaderList();
+    std::swap(m_spm_offset_nm_list[current_row], m_spm_offset_nm_list[current_row + 1]);
+    swapSpmImages(current_row, current_row + 1);
 
     updateListWidgetFiles();
 }
 
 void MainWindow::on_btn_preview_clicked() {
+    if (!loadSpmImages()) {
+        printLog("Reading spm files error!", "error");
+        return;
+    }
+
+    std::vector<cv::Mat> image_f1_list = m_tile_store.getAll();
+
     SpmStitching stitching;
     cv::Mat stitched_image;
-    if (stitching.execStitchingImage(m_image_f1_list, &stitched_image).empty()) {
+    if (stitching.execStitchingImage(m_spm_reader_list, image_f1_list, &stitched_image).empty()) {
         printLog("Image stitching preview failed!", "error");
         return;
     }
@@ -118,9 +140,21 @@ void MainWindow::on_btn_save_clicked() {
     }
     slashLeftToRight(save_file);
 
+    // 预览用的图块经过量化，保存时重新读取全精度的拉平图像（命中 m_tile_cache 时跳过解码与拉平）
+    std::string image_type = ui->comboBox_spm_type->currentText().toStdString();
+    std::vector<SpmReader> spm_reader_list;
+    std::vector<cv::Mat> image_f1_list;
+
     SpmStitching stitching;
+    stitching.setDataPrecision(SpmImage::DataPrecision::Float32);
+    stitching.setTileCache(m_tile_cache);
+    if (!stitching.loadSpmfromSpmPath(m_spm_path_list, image_type, spm_reader_list, image_f1_list)) {
+        printLog("Reading spm files error!", "error");
+        return;
+    }
+
     cv::Mat stitched_image;
-    if (!stitching.execStitching(m_spm_reader_list, m_image_f1_list,
+    if (!stitching.execStitching(spm_reader_list, image_f1_list,
                                  save_file.toStdString(),
                                  &stitched_image)) {
         printLog("Spm stitching failed!", "error");
@@ -169,23 +203,39 @@ void MainWindow::updatePreviewImage() {
     ui->label_preview_image->setPixmap(qpixmap);
 }
 
-void MainWindow::reloadSpmReaderList() {
-    m_spm_offset_nm_list.clear();
-    m_spm_reader_list.clear();
-    for (int i = 0; i < m_spm_path_list.size(); i++) {
-        SpmReader spm(m_spm_path_list[i], ui->comboBox_spm_type->currentText().toStdString());
-        if (!spm.readSpm()) {
-            std::cout << "Reading spm file error!" << std::endl;
-            continue;
-        }
-        SpmAlgorithm::flattenFirst(spm.getImageSingle());
+bool MainWindow::loadSpmImages() {
+    std::string image_type = ui->comboBox_spm_type->currentText().toStdString();
 
-        // add spm offset nm
-        m_spm_offset_nm_list.emplace_back(std::pair<int, int>{spm.getXOffsetNM(), spm.getYOffsetNM()});
+    // 文件列表与通道未变化时复用已解码的图像
+    if (!m_spm_reader_list.empty() && m_spm_reader_list.size() == m_spm_path_list.size() &&
+        image_type == m_loaded_image_type) {
+        return true;
+    }
 
-        // add spm reader
-        m_spm_reader_list.emplace_back(std::move(spm));
+    SpmStitching stitching;
+    stitching.setDataPrecision(SpmImage::DataPrecision::Float32);
+    stitching.setTileCache(m_tile_cache);
+    if (!stitching.loadSpmfromSpmPath(m_spm_path_list, image_type, m_spm_reader_list, m_tile_store)) {
+        clearSpmImages();
+        return false;
     }
+    m_loaded_image_type = image_type;
+
+    return true;
+}
+
+void MainWindow::clearSpmImages() {
+    m_spm_reader_list.clear();
+    m_tile_store.clear();
+    m_loaded_image_type.clear();
+}
+
+void MainWindow::swapSpmImages(int row_a, int row_b) {
+    // 已读取的图像随文件列表一起调整顺序，无需重新读取
+    if (m_spm_reader_list.empty()) return;
+
+    std::swap(m_spm_reader_list[row_a], m_spm_reader_list[row_b]);
+    m_tile_store.swap(row_a, row_b);
 }
 
 void MainWindow::slashLeftToRight(QString &str) {
@@ -3,10 +3,12 @@
 
 #include <QMainWindow>
 #include <QRegularExpressionValidator>
+#include <QStandardPaths>
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
 #include <utility>
 #include <algorithm>
 #include <chrono>
@@ -52,7 +54,11 @@ private:
 
     void updatePreviewImage();
 
-    void reloadSpmReaderList();
+    bool loadSpmImages();
+
+    void clearSpmImages();
+
+    void swapSpmImages(int row_a, int row_b);
 
     void slashLeftToRight(QString &str);
 
@@ -64,8 +70,10 @@ private:
 
     std::vector<std::string> m_spm_path_list;
     std::vector<SpmReader> m_spm_reader_list;
-    std::vector<cv::Mat> m_image_f1_list;
+    SpmTileStore m_tile_store{SpmTileStore::Mode::Quantized};  // 拉平后的图像，量化压缩保存，仅用于预览
     std::vector<std::pair<int, int>> m_spm_offset_nm_list;
+    std::string m_loaded_image_type;
+    std::shared_ptr<SpmTileCache> m_tile_cache;
     cv::Mat m_preview_image;
 };
 
@@ -2,13 +2,71 @@
 #define SPM_ALGORITHM_HPP
 
 #include "spm_reader.hpp"
+#include "spm_flatten.hpp"
 
 #include <stdexcept>
-#include <numeric>
+#include <memory>
 
 #include "opencv2/opencv.hpp"
 
 
+/**
+ * @brief 让 cv::Mat 共同持有外部缓冲区的 MatAllocator
+ *
+ * cv::Mat 包装外部数据时默认不持有所有权。wrap() 为 Mat 挂上一个 UMatData，其 userdata 保存缓冲区所有者的
+ * shared_ptr；Mat 及其拷贝共用 UMatData 的引用计数，最后一个 Mat 释放时才释放所有者。
+ * 该分配器只用于释放，不分配新内存（create() 等仍使用 OpenCV 默认分配器）。
+ */
+class SpmSharedMatAllocator : public cv::MatAllocator {
+public:
+    /**
+     * @brief 包装 data 为 cv::Mat，并让其共同持有 owner
+     *
+     * @param data The first element, must stay valid while owner is alive.
+     * @param step The row step in bytes.
+     * @param owner The owner of the buffer.
+     * @return mat header pointing at data
+     */
+    static cv::Mat wrap(int rows, int cols, int type, void *data, size_t step, std::shared_ptr<const void> owner) {
+        cv::Mat image(rows, cols, type, data, step);
+
+        auto *u = new cv::UMatData(&instance());
+        u->data = u->origdata = image.data;
+        u->size = step * rows;
+        u->flags = cv::UMatData::USER_ALLOCATED;
+        u->userdata = new std::shared_ptr<const void>(std::move(owner));
+        u->refcount = 1;
+        image.u = u;
+
+        return image;
+    }
+
+    static const SpmSharedMatAllocator &instance() {
+        static SpmSharedMatAllocator allocator;
+        return allocator;
+    }
+
+    cv::UMatData *allocate(int, const int *, int, void *, size_t *, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        return nullptr;
+    }
+
+    bool allocate(cv::UMatData *, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        return false;
+    }
+
+    void deallocate(cv::UMatData *u) const override {
+        if (u == nullptr || u->refcount != 0 || u->urefcount != 0) return;
+
+        delete static_cast<std::shared_ptr<const void> *>(u->userdata);
+        u->userdata = nullptr;
+        delete u;
+    }
+
+private:
+    SpmSharedMatAllocator() = default;
+};
+
+
 class SpmAlgorithm : public StringOperations {
 private:
     SpmAlgorithm() = default;
@@ -19,46 +77,111 @@ public:
     /**
      * @brief 一阶拉平处理
      *
-     * @param data The SPM image real data.
+     * @param data The SPM image real data, rows of double or float (e.g. std::vector<std::vector<double>>).
      * @return None
      */
     template<typename T>
     static void flattenFirst(T &data) {
-        const int num_cols = (int) data[0].size();
+        if (data.size() == 0) return;
 
-        double sum_m_mu = 0.0;
-        double x_mean = (num_cols - 1) / 2.0;
-        for (int c = 0; c < num_cols; ++c) {
-            sum_m_mu += std::pow(c - x_mean, 2);
+        std::shared_ptr<const SpmPolyBasis> basis = SpmPolyBasis::get((int) data[0].size(), 1);
+        for (auto &row : data) {
+            SpmFlatten::flattenRow(&row[0], *basis);
         }
+    }
 
-        for (auto &row : data) {
-            double row_mean = std::accumulate(row.begin(), row.end(), 0.0) / num_cols;
+    /**
+     * @brief 一阶拉平处理，各行按行块并行处理
+     *
+     * @param data The SPM image real data.
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return None
+     */
+    template<typename T>
+    static void flattenFirst(SpmHeightMap<T> &data, int max_workers = 0) {
+        SpmFlatten::flattenFirst(data.view(), max_workers);
+    }
 
-            double sum_m_zi = 0.0;
-            for (auto it = row.begin(); it != row.end(); ++it) {
-                int c = (int) std::distance(row.begin(), it);
-                sum_m_zi += (c - x_mean) * (*it - row_mean);
-            }
+    /**
+     * @brief 一阶拉平处理
+     *
+     * @param spm_image The SPM image.
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return None
+     */
+    static void flattenFirst(SpmImage &spm_image, int max_workers = 0) {
+        if (spm_image.getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            flattenFirst(spm_image.getRealDataF32(), max_workers);  // 拟合过程仍以 double 累加
+        } else {
+            flattenFirst(spm_image.getRealData(), max_workers);
+        }
+    }
 
-            double m = sum_m_zi / sum_m_mu;
-            double b = row_mean - m * x_mean;
+    /**
+     * @brief 拉平处理: 逐行多项式（Line）或整幅图像的多项式曲面（Surface），各行按行块并行处理
+     *
+     * @param data The SPM image real data.
+     * @param mode SpmFlatten::Mode::Line or SpmFlatten::Mode::Surface.
+     * @param order The polynomial order, [0, SpmFlatten::max_order]. Line 1 is flattenFirst, Surface 1 is plane.
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return false if the order is out of range
+     */
+    template<typename T>
+    static bool flatten(SpmHeightMap<T> &data, SpmFlatten::Mode mode, int order, int max_workers = 0) {
+        return SpmFlatten::flatten(data.view(), mode, order, max_workers);
+    }
 
-            for (auto &element : row) {
-                int c = (int) (&element - &row[0]);
-                element -= (m * c + b);
-            }
+    /**
+     * @brief 拉平处理
+     *
+     * @param spm_image The SPM image.
+     * @param mode SpmFlatten::Mode::Line or SpmFlatten::Mode::Surface.
+     * @param order The polynomial order, [0, SpmFlatten::max_order].
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return false if the order is out of range
+     */
+    static bool flatten(SpmImage &spm_image, SpmFlatten::Mode mode, int order, int max_workers = 0) {
+        if (spm_image.getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            return flatten(spm_image.getRealDataF32(), mode, order, max_workers);  // 拟合过程仍以 double 累加
+        } else {
+            return flatten(spm_image.getRealData(), mode, order, max_workers);
         }
     }
 
     /**
-     * @brief 一阶拉平处理
+     * @brief 稳健 / 掩膜拉平处理: 排除颗粒、台阶等残差过大的像素或掩膜外的像素后重新拟合
      *
      * @param spm_image The SPM image.
-     * @return None
+     * @param mode SpmFlatten::Mode::Line or SpmFlatten::Mode::Surface.
+     * @param order The polynomial order, [0, SpmFlatten::max_order].
+     * @param robust The robust fitting parameters, SpmFlatten::Robust{0} for a plain fit.
+     * @param mask Optional, same size as the image. Only pixels with a nonzero mask value are used in the fit.
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return false if the order, the robust parameters or the mask size is invalid
      */
-    static void flattenFirst(SpmImage &spm_image) {
-        flattenFirst(spm_image.getRealData());
+    static bool flatten(SpmImage &spm_image, SpmFlatten::Mode mode, int order, const SpmFlatten::Robust &robust,
+                        SpmHeightMapView<const unsigned char> mask = {}, int max_workers = 0) {
+        if (spm_image.getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            return SpmFlatten::flatten(spm_image.getRealDataF32().view(), mode, order, robust, mask, max_workers);
+        } else {
+            return SpmFlatten::flatten(spm_image.getRealData().view(), mode, order, robust, mask, max_workers);
+        }
+    }
+
+    /**
+     * @brief 流式一阶拉平处理: 按行条带解码并拉平，不保存整幅图像（一阶拉平逐行独立拟合，与整幅处理结果一致）
+     *
+     * @param spm_image The SPM image.
+     * @param fn The strip callback, called as fn(int first_row, const SpmHeightMapView<T> &strip) with flattened rows.
+     * @param strip_rows The number of rows per strip.
+     * @return false if the SPM image data is not available
+     */
+    template<typename T = double, typename Fn>
+    static bool flattenFirstStrips(SpmImage &spm_image, Fn &&fn, int strip_rows = SpmImage::default_strip_rows) {
+        return spm_image.decodeStrips<T>(strip_rows, [&](int first_row, const SpmHeightMapView<T> &strip) {
+            SpmFlatten::flattenFirst(strip, 1);  // 条带较小，在当前线程中处理
+            fn(first_row, strip);
+        });
     }
 
     /**
@@ -75,8 +198,10 @@ public:
         cv::Mat image(rows, cols, CV_64FC1);
 
         for (int r = 0; r < rows; ++r) {
+            auto *image_row = image.ptr<double>(r);
+            const auto &array_row = array[r];
             for (int c = 0; c < cols; ++c) {
-                image.at<double>(r, c) = array[r][c];
+                image_row[c] = array_row[c];
             }
         }
 
@@ -84,13 +209,105 @@ public:
     }
 
     /**
-     * @brief 将 SPM Image 的 Real Data 转为 OpenCV Mat 对象
+     * @brief 将二维高度数据转为 OpenCV Mat 对象（连续内存整块拷贝）
      *
-     * @param spm_image The SPM image.
+     * @param height_map 2D height map
      * @return mat object
      */
+    template<typename T>
+    static cv::Mat array2DToImage(const SpmHeightMap<T> &height_map) {
+        return wrapHeightMap(height_map.view()).clone();
+    }
+
+    /**
+     * @brief 将二维高度数据包装为 OpenCV Mat 对象，不拷贝数据
+     *
+     * @param height_map 2D height map view. The returned mat is only valid while the height map is alive
+     *                   and not reallocated.
+     * @return mat header pointing at the height map buffer
+     */
+    template<typename T>
+    static cv::Mat wrapHeightMap(const SpmHeightMapView<T> &height_map) {
+        using value_type = std::remove_const_t<T>;
+        if (height_map.empty()) return {};
+
+        return {height_map.rows(), height_map.cols(), cv::traits::Type<value_type>::value,
+                const_cast<value_type *>(height_map.data()), height_map.stride() * sizeof(value_type)};
+    }
+
+    /**
+     * @brief 将二维高度数据包装为 OpenCV Mat 对象，不拷贝数据，Mat 共同持有 height_map
+     *
+     * @param height_map 2D height map. The returned mat (and its copies) keeps it alive; it must not be
+     *                   reallocated while a mat refers to it.
+     * @return mat header pointing at the height map buffer
+     */
+    template<typename T>
+    static cv::Mat wrapHeightMap(std::shared_ptr<SpmHeightMap<T>> height_map) {
+        if (!height_map || height_map->empty()) return {};
+
+        SpmHeightMap<T> &data = *height_map;
+        return SpmSharedMatAllocator::wrap(data.rows(), data.cols(), cv::traits::Type<T>::value,
+                                           data.data(), data.stride() * sizeof(T), std::move(height_map));
+    }
+
+    /**
+     * @brief 将单通道 OpenCV Mat 对象转为二维高度数据
+     *
+     * @param image single channel mat object
+     * @return 2D height map
+     */
+    template<typename T = double>
+    static SpmHeightMap<T> imageToHeightMap(const cv::Mat &image) {
+        SpmHeightMap<T> height_map;
+        if (image.empty()) return height_map;
+
+        height_map.create(image.rows, image.cols);
+        cv::Mat height_map_image = wrapHeightMap(height_map.view());
+        image.convertTo(height_map_image, cv::traits::Type<T>::value);  // 尺寸与类型一致，直接写入 height_map
+
+        return height_map;
+    }
+
+    /**
+     * @brief 将 SPM Image 的 Real Data 转为 OpenCV Mat 对象（拷贝数据）
+     *
+     * @param spm_image The SPM image.
+     * @return mat object, CV_32FC1 or CV_64FC1 according to the data precision of the SPM image
+     */
     static cv::Mat spmImageToImage(SpmImage &spm_image) {
-        return array2DToImage(spm_image.getRealData());
+        return spmImageToImageView(spm_image).clone();
+    }
+
+    /**
+     * @brief 将 SPM Image 的 Real Data 包装为 OpenCV Mat 对象，不拷贝数据
+     *
+     * @param spm_image The SPM image. The returned mat is only valid while the real data of the SPM image is
+     *                  alive, i.e. until the image is destroyed, released or its data is taken.
+     * @return mat header, CV_32FC1 or CV_64FC1 according to the data precision of the SPM image
+     */
+    static cv::Mat spmImageToImageView(SpmImage &spm_image) {
+        if (spm_image.getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            return wrapHeightMap(spm_image.getRealDataF32().view());  // CV_32FC1
+        } else {
+            return wrapHeightMap(spm_image.getRealData().view());  // CV_64FC1
+        }
+    }
+
+    /**
+     * @brief 取走 SPM Image 的 Real Data 并转为 OpenCV Mat 对象，不拷贝数据
+     *
+     * 缓冲区所有权转移给返回的 Mat（及其拷贝），SPM Image 随后只保留图像属性，同 SpmImage::releaseImageData()。
+     *
+     * @param spm_image The SPM image.
+     * @return mat object, CV_32FC1 or CV_64FC1 according to the data precision of the SPM image
+     */
+    static cv::Mat takeSpmImageToImage(SpmImage &spm_image) {
+        if (spm_image.getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            return wrapHeightMap(std::make_shared<SpmHeightMap<float>>(spm_image.takeRealDataF32()));
+        } else {
+            return wrapHeightMap(std::make_shared<SpmHeightMap<double>>(spm_image.takeRealData()));
+        }
     }
 
     /**
@@ -101,8 +318,8 @@ public:
      * @return None
      */
     static void saveSpmImageToImage(SpmImage &spm_image, const std::string &file_path) {
-        cv::Mat image = array2DToImage(spm_image.getRealData());
-        cv::normalize(image, image, 0, 255, cv::NORM_MINMAX);
+        cv::Mat image;
+        cv::normalize(spmImageToImageView(spm_image), image, 0, 255, cv::NORM_MINMAX);
 
         cv::imwrite(file_path, image);
     }
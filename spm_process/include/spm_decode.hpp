@@ -0,0 +1,136 @@
+#ifndef SPM_DECODE_HPP
+#define SPM_DECODE_HPP
+
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+
+#include "spm_height_map.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPM_DECODE_SSE2
+#endif
+
+
+/**
+ * @brief SPM 图像数据解码内核
+ *
+ * 按 bytes/pixel 在编译期特化，一次遍历完成行翻转与 int16 / int32 -> double / float 的换算。
+ * 换算系数 (z_scale_sens * z_scale / 2^(8 * bytes_per_pixel)) 由调用方预先计算。
+ */
+class SpmDecodeKernel {
+private:
+    SpmDecodeKernel() = default;
+
+    ~SpmDecodeKernel() = default;
+
+public:
+    template<int BytesPerPixel>
+    using RawType = std::conditional_t<BytesPerPixel == 2, short, int>;
+
+    /**
+     * @brief 将字节数据加宽为 int 类型的 raw data（文件中的行顺序）
+     *
+     * @param byte_data The image byte data, no alignment required.
+     * @param count The number of pixels.
+     * @param raw_data The output raw data.
+     * @return None
+     */
+    template<int BytesPerPixel>
+    static void widenRawData(const char *byte_data, size_t count, int *raw_data) {
+        static_assert(BytesPerPixel == 2 || BytesPerPixel == 4, "Bytes/pixel must be 2 or 4");
+
+        if constexpr (BytesPerPixel == 4) {
+            std::memcpy(raw_data, byte_data, count * sizeof(int));
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                short value;
+                std::memcpy(&value, byte_data + i * sizeof(short), sizeof(short));
+                raw_data[i] = value;
+            }
+        }
+    }
+
+    /**
+     * @brief 解码一行像素: dst[c] = raw[c] * scale
+     *
+     * @param byte_data The byte data of the line, no alignment required.
+     * @param line_data The output line.
+     * @param cols The number of pixels in the line.
+     * @param scale The precomputed scale factor.
+     * @return None
+     */
+    template<int BytesPerPixel, typename OutT>
+    static void decodeRow(const char *byte_data, OutT *line_data, int cols, double scale) {
+        static_assert(BytesPerPixel == 2 || BytesPerPixel == 4, "Bytes/pixel must be 2 or 4");
+        static_assert(std::is_same_v<OutT, double> || std::is_same_v<OutT, float>, "Output must be double or float");
+
+        int c = 0;
+
+#ifdef SPM_DECODE_SSE2
+        const __m128d scale_pd = _mm_set1_pd(scale);
+        if constexpr (BytesPerPixel == 2) {
+            for (; c + 8 <= cols; c += 8) {
+                __m128i raw_16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(byte_data + c * 2));
+                // 符号扩展 int16 -> int32
+                __m128i raw_lo = _mm_srai_epi32(_mm_unpacklo_epi16(raw_16, raw_16), 16);
+                __m128i raw_hi = _mm_srai_epi32(_mm_unpackhi_epi16(raw_16, raw_16), 16);
+                storeScaled(line_data + c, raw_lo, scale_pd);
+                storeScaled(line_data + c + 4, raw_hi, scale_pd);
+            }
+        } else {
+            for (; c + 4 <= cols; c += 4) {
+                __m128i raw_32 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(byte_data + c * 4));
+                storeScaled(line_data + c, raw_32, scale_pd);
+            }
+        }
+#endif
+
+        for (; c < cols; ++c) {
+            RawType<BytesPerPixel> value;
+            std::memcpy(&value, byte_data + c * BytesPerPixel, BytesPerPixel);
+            line_data[c] = (OutT) (value * scale);
+        }
+    }
+
+    /**
+     * @brief 解码整幅图像并翻转行顺序: 输出的第 r 行对应文件中的第 (rows - 1 - r) 行
+     *
+     * @param byte_data The image byte data (rows x cols pixels).
+     * @param real_data The output height map view, rows x cols.
+     * @param scale The precomputed scale factor.
+     * @return None
+     */
+    template<int BytesPerPixel, typename OutT>
+    static void decodeFlipped(const char *byte_data, const SpmHeightMapView<OutT> &real_data, double scale) {
+        const int rows = real_data.rows();
+        const int cols = real_data.cols();
+        const size_t line_bytes = (size_t) cols * BytesPerPixel;
+
+        for (int r = 0; r < rows; ++r) {
+            decodeRow<BytesPerPixel>(byte_data + (size_t) (rows - 1 - r) * line_bytes, real_data.rowPtr(r), cols,
+                                     scale);
+        }
+    }
+
+private:
+#ifdef SPM_DECODE_SSE2
+    static void storeScaled(double *dst, __m128i raw_32, __m128d scale_pd) {
+        __m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(raw_32), scale_pd);
+        __m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(raw_32, _MM_SHUFFLE(1, 0, 3, 2))), scale_pd);
+        _mm_storeu_pd(dst, lo);
+        _mm_storeu_pd(dst + 2, hi);
+    }
+
+    static void storeScaled(float *dst, __m128i raw_32, __m128d scale_pd) {
+        // 以 double 计算后再转换为 float，避免 int32 直接转 float 损失精度
+        __m128d lo = _mm_mul_pd(_mm_cvtepi32_pd(raw_32), scale_pd);
+        __m128d hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(raw_32, _MM_SHUFFLE(1, 0, 3, 2))), scale_pd);
+        _mm_storeu_ps(dst, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+    }
+#endif
+};
+
+
+#endif //SPM_DECODE_HPP
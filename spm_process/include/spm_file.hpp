@@ -0,0 +1,296 @@
+#ifndef SPM_FILE_HPP
+#define SPM_FILE_HPP
+
+#include <string>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+/**
+ * @brief 只读文件，按偏移读取（POSIX: pread; Windows: ReadFile + OVERLAPPED），不依赖文件指针，可被多个线程同时读取
+ *
+ * 路径统一使用 std::filesystem::path，由 UTF-8 字符串构造（见 fromUtf8()），Windows 上同样支持非 ASCII 路径。
+ */
+class SpmFile {
+public:
+    SpmFile() = default;
+
+    ~SpmFile() {
+        close();
+    }
+
+    SpmFile(const SpmFile &) = delete;
+
+    SpmFile &operator=(const SpmFile &) = delete;
+
+    SpmFile(SpmFile &&other) noexcept {
+        moveFrom(other);
+    }
+
+    SpmFile &operator=(SpmFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+public:
+    /**
+     * @brief UTF-8 路径字符串（如 QString::toStdString() 的结果）转 std::filesystem::path
+     */
+    static std::filesystem::path fromUtf8(const std::string &utf8_path) {
+        return std::filesystem::u8path(utf8_path);
+    }
+
+    bool open(const std::filesystem::path &path) {
+        close();
+
+#ifdef _WIN32
+        m_file_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file_handle == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(m_file_handle, &file_size)) {
+            close();
+            return false;
+        }
+        m_size = (unsigned long long) file_size.QuadPart;
+#else
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) return false;
+
+        struct stat file_stat{};
+        if (fstat(m_fd, &file_stat) != 0) {
+            close();
+            return false;
+        }
+        m_size = (unsigned long long) file_stat.st_size;
+#endif
+
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (m_file_handle != INVALID_HANDLE_VALUE) CloseHandle(m_file_handle);
+        m_file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+#endif
+        m_size = 0;
+    }
+
+    bool isOpen() const {
+#ifdef _WIN32
+        return m_file_handle != INVALID_HANDLE_VALUE;
+#else
+        return m_fd >= 0;
+#endif
+    }
+
+    unsigned long long size() const { return m_size; }
+
+    /**
+     * @brief 从 offset 处读取 size 个字节
+     *
+     * @param offset The file offset.
+     * @param buffer The output buffer.
+     * @param size The number of bytes to read.
+     * @return the number of bytes read, less than size only at end of file or on error
+     */
+    size_t readAt(unsigned long long offset, char *buffer, size_t size) const {
+        size_t total_read = 0;
+        while (total_read < size) {
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            unsigned long long position = offset + total_read;
+            overlapped.Offset = (DWORD) (position & 0xFFFFFFFFULL);
+            overlapped.OffsetHigh = (DWORD) (position >> 32);
+
+            DWORD chunk_size = (DWORD) std::min<size_t>(size - total_read, 1U << 30);
+            DWORD read_size = 0;
+            if (!ReadFile(m_file_handle, buffer + total_read, chunk_size, &read_size, &overlapped) ||
+                read_size == 0) {
+                break;
+            }
+#else
+            ssize_t read_size = pread(m_fd, buffer + total_read, size - total_read, (off_t) (offset + total_read));
+            if (read_size < 0 && errno == EINTR) continue;
+            if (read_size <= 0) break;
+#endif
+            total_read += (size_t) read_size;
+        }
+
+        return total_read;
+    }
+
+private:
+    void moveFrom(SpmFile &other) {
+        m_size = other.m_size;
+        other.m_size = 0;
+#ifdef _WIN32
+        m_file_handle = other.m_file_handle;
+        other.m_file_handle = INVALID_HANDLE_VALUE;
+#else
+        m_fd = other.m_fd;
+        other.m_fd = -1;
+#endif
+    }
+
+private:
+    unsigned long long m_size = 0;
+
+#ifdef _WIN32
+    HANDLE m_file_handle = INVALID_HANDLE_VALUE;
+#else
+    int m_fd = -1;
+#endif
+};
+
+
+/**
+ * @brief 只读内存映射文件
+ *
+ * 将整个文件映射到进程地址空间，读取时直接访问映射内存，无需 fread 到中间缓冲区。
+ */
+class SpmMappedFile {
+public:
+    SpmMappedFile() = default;
+
+    ~SpmMappedFile() {
+        close();
+    }
+
+    SpmMappedFile(const SpmMappedFile &) = delete;
+
+    SpmMappedFile &operator=(const SpmMappedFile &) = delete;
+
+    SpmMappedFile(SpmMappedFile &&other) noexcept {
+        moveFrom(other);
+    }
+
+    SpmMappedFile &operator=(SpmMappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+public:
+    bool open(const std::filesystem::path &path) {
+        close();
+
+#ifdef _WIN32
+        m_file_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file_handle == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(m_file_handle, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        m_size = (size_t) file_size.QuadPart;
+
+        m_mapping_handle = CreateFileMappingW(m_file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping_handle) {
+            close();
+            return false;
+        }
+
+        m_data = static_cast<const char *>(MapViewOfFile(m_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (!m_data) {
+            close();
+            return false;
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        m_size = (size_t) file_stat.st_size;
+
+        void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // 映射建立后即可关闭文件描述符
+        if (data == MAP_FAILED) {
+            m_size = 0;
+            return false;
+        }
+        m_data = static_cast<const char *>(data);
+#endif
+
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping_handle) CloseHandle(m_mapping_handle);
+        if (m_file_handle != INVALID_HANDLE_VALUE) CloseHandle(m_file_handle);
+        m_mapping_handle = nullptr;
+        m_file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (m_data) munmap(const_cast<char *>(m_data), m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool isOpen() const { return m_data != nullptr; }
+
+    const char *data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+    /**
+     * @brief 检查 [offset, offset + length) 是否位于映射范围内
+     */
+    bool contains(size_t offset, size_t length) const {
+        return offset <= m_size && length <= m_size - offset;
+    }
+
+private:
+    void moveFrom(SpmMappedFile &other) {
+        m_data = other.m_data;
+        m_size = other.m_size;
+        other.m_data = nullptr;
+        other.m_size = 0;
+#ifdef _WIN32
+        m_file_handle = other.m_file_handle;
+        m_mapping_handle = other.m_mapping_handle;
+        other.m_file_handle = INVALID_HANDLE_VALUE;
+        other.m_mapping_handle = nullptr;
+#endif
+    }
+
+private:
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    HANDLE m_file_handle = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping_handle = nullptr;
+#endif
+};
+
+
+#endif //SPM_FILE_HPP
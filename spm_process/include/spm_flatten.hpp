@@ -0,0 +1,763 @@
+#ifndef SPM_FLATTEN_HPP
+#define SPM_FLATTEN_HPP
+
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "spm_height_map.hpp"
+#include "spm_parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPM_FLATTEN_SSE2
+#endif
+
+
+/**
+ * @brief n 个等距采样点上的离散正交多项式基 q_0 ... q_order
+ *
+ * 由三项递推在归一化坐标 t = (i - (n - 1) / 2) / ((n - 1) / 2) 上生成并单位化，q_0 为常数 1 / sqrt(n)。
+ * 正交基下最小二乘拟合的系数即 a_j = sum(q_j * z)，拟合值为 sum(a_j * q_j)，相当于预先求好了伪逆，
+ * 无需对每行求解法方程。阶数超过 n - 1 时按 n - 1 截断。只与 (n, order) 有关，通过 get() 缓存，
+ * 所有行、所有图像共用。
+ */
+class SpmPolyBasis {
+public:
+    SpmPolyBasis(int n, int order)
+            : m_n(std::max(n, 0)), m_order(std::max(0, std::min(order, n - 1))) {
+        m_data.assign((size_t) (m_order + 1) * m_n, 0.0);
+        if (m_n == 0) return;
+
+        double half_range = (m_n - 1) / 2.0;
+        std::vector<double> t(m_n);
+        for (int i = 0; i < m_n; ++i) {
+            t[i] = half_range > 0.0 ? (i - half_range) / half_range : 0.0;
+        }
+
+        // p_{j+1} = (t - alpha_j) * p_j - beta_j * p_{j-1}，p_j 已单位化时 beta_j 即上一步的范数
+        std::vector<double> p_prev(m_n, 0.0), p_curr(m_n, 1.0 / std::sqrt((double) m_n)), p_next(m_n);
+        double beta = 0.0;
+        for (int j = 0; ; ++j) {
+            std::copy(p_curr.begin(), p_curr.end(), m_data.begin() + (size_t) j * m_n);
+            if (j == m_order) break;
+
+            double alpha = 0.0;
+            for (int i = 0; i < m_n; ++i) alpha += t[i] * p_curr[i] * p_curr[i];
+
+            double norm = 0.0;
+            for (int i = 0; i < m_n; ++i) {
+                p_next[i] = (t[i] - alpha) * p_curr[i] - beta * p_prev[i];
+                norm += p_next[i] * p_next[i];
+            }
+            norm = std::sqrt(norm);
+            for (int i = 0; i < m_n; ++i) p_next[i] /= norm;
+
+            std::swap(p_prev, p_curr);
+            std::swap(p_curr, p_next);
+            beta = norm;
+        }
+    }
+
+    ~SpmPolyBasis() = default;
+
+public:
+    /**
+     * @brief 获取 (n, order) 的正交基，首次使用时计算，线程安全
+     */
+    static std::shared_ptr<const SpmPolyBasis> get(int n, int order) {
+        static std::mutex cache_mutex;
+        static std::unordered_map<long long, std::shared_ptr<const SpmPolyBasis>> cache;
+
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto &basis = cache[((long long) n << 8) | (order & 0xFF)];
+        if (!basis) basis = std::make_shared<const SpmPolyBasis>(n, order);
+        return basis;
+    }
+
+    int size() const { return m_n; }
+
+    // 实际阶数，不超过 size() - 1
+    int order() const { return m_order; }
+
+    // q_j[0 .. size())
+    const double *basis(int j) const { return m_data.data() + (size_t) j * m_n; }
+
+    // q_0 的常数值
+    double constant() const { return m_n > 0 ? m_data[0] : 0.0; }
+
+private:
+    int m_n;
+    int m_order;
+    std::vector<double> m_data;  // (order + 1) x n，行主序
+};
+
+
+/**
+ * @brief 最小二乘拟合的法方程 G * a = b，G = sum(phi * phi^T)，b = sum(phi * z)
+ *
+ * 在正交基下，全部像素参与拟合时 G 为单位矩阵。稳健拟合中像素被排除或重新加入时只增减该像素的贡献，
+ * 不必每次迭代都从头累加法方程。
+ */
+class SpmFitSystem {
+public:
+    explicit SpmFitSystem(int size = 0, bool identity = true) { reset(size, identity); }
+
+    ~SpmFitSystem() = default;
+
+public:
+    void reset(int size, bool identity) {
+        m_size = size;
+        m_gram.assign((size_t) size * size, 0.0);
+        m_rhs.assign((size_t) size, 0.0);
+        if (identity) {
+            for (int a = 0; a < size; ++a) m_gram[(size_t) a * size + a] = 1.0;
+        }
+    }
+
+    int size() const { return m_size; }
+
+    double *rhs() { return m_rhs.data(); }
+
+    /**
+     * @brief 增加（weight = 1）或移除（weight = -1）一个像素的贡献
+     *
+     * @param phi The basis values at the pixel, size() elements.
+     * @param z The pixel value.
+     */
+    void update(const double *phi, double z, double weight) {
+        for (int a = 0; a < m_size; ++a) {
+            double weighted_phi = weight * phi[a];
+            m_rhs[a] += weighted_phi * z;
+            double *gram_row = m_gram.data() + (size_t) a * m_size;
+            for (int b = 0; b < m_size; ++b) gram_row[b] += weighted_phi * phi[b];
+        }
+    }
+
+    void add(const SpmFitSystem &other) {
+        for (size_t i = 0; i < m_gram.size(); ++i) m_gram[i] += other.m_gram[i];
+        for (size_t i = 0; i < m_rhs.size(); ++i) m_rhs[i] += other.m_rhs[i];
+    }
+
+    /**
+     * @brief 列主元高斯消元求解
+     *
+     * @param solution The output coefficients, size() elements.
+     * @return false if the system is singular, e.g. too few pixels are left in the fit
+     */
+    bool solve(double *solution) const {
+        const int n = m_size;
+        std::vector<double> a(m_gram);
+        std::vector<double> b(m_rhs);
+
+        for (int p = 0; p < n; ++p) {
+            int pivot = p;
+            for (int r = p + 1; r < n; ++r) {
+                if (std::fabs(a[(size_t) r * n + p]) > std::fabs(a[(size_t) pivot * n + p])) pivot = r;
+            }
+            if (std::fabs(a[(size_t) pivot * n + p]) < singular_epsilon) return false;
+            if (pivot != p) {
+                for (int c = 0; c < n; ++c) std::swap(a[(size_t) p * n + c], a[(size_t) pivot * n + c]);
+                std::swap(b[p], b[pivot]);
+            }
+
+            for (int r = p + 1; r < n; ++r) {
+                double factor = a[(size_t) r * n + p] / a[(size_t) p * n + p];
+                for (int c = p; c < n; ++c) a[(size_t) r * n + c] -= factor * a[(size_t) p * n + c];
+                b[r] -= factor * b[p];
+            }
+        }
+
+        for (int r = n - 1; r >= 0; --r) {
+            double sum = b[r];
+            for (int c = r + 1; c < n; ++c) sum -= a[(size_t) r * n + c] * solution[c];
+            solution[r] = sum / a[(size_t) r * n + r];
+        }
+        return true;
+    }
+
+private:
+    // 正交基下 G 的特征值在 [0, 1] 之间，主元过小说明剩余像素不足以确定拟合
+    static constexpr double singular_epsilon = 1e-10;
+
+    int m_size = 0;
+    std::vector<double> m_gram;
+    std::vector<double> m_rhs;
+};
+
+
+/**
+ * @brief 稳健拟合参数
+ *
+ * 每次迭代计算参与拟合像素的残差标准差 sigma（Line 模式逐行计算，Surface 模式整幅图像计算），
+ * |残差| > threshold_sigma * sigma 的像素（颗粒、台阶等）不参与下一次拟合，被误排除的像素会重新加入。
+ * 参与拟合的像素不再变化或达到 max_iterations 时结束，max_iterations = 0 为普通拟合。
+ */
+struct SpmFlattenRobust {
+    int max_iterations = 3;
+    double threshold_sigma = 2.5;
+
+    bool enabled() const { return max_iterations > 0; }
+};
+
+
+/**
+ * @brief 拉平处理内核
+ *
+ * Line 模式对每行独立拟合 order 阶多项式并减去拟合值（order = 1 即一阶拉平）；
+ * Surface 模式对整幅图像拟合总次数不超过 order 的二维多项式曲面并减去（order = 1 即平面拉平）。
+ *
+ * 拟合基于 SpmPolyBasis: 每行一次遍历同时累加所有基函数与数据的内积，再一次遍历减去拟合值，
+ * 行数据在两次遍历之间留在缓存中。二维曲面使用 x、y 正交基的乘积 qx_i(c) * qy_j(r)（i + j <= order），
+ * 它们在整幅图像上仍然正交，因此曲面拟合同样分解为逐行的内积与减法，共两次遍历图像。
+ * 拟合过程以 double 计算，各行按行块分配到多个线程。
+ *
+ * 稳健拟合（见 Robust）与掩膜只改变参与拟合的像素，拟合值仍从所有像素中减去。
+ */
+class SpmFlatten {
+private:
+    SpmFlatten() = default;
+
+    ~SpmFlatten() = default;
+
+public:
+    enum class Mode {
+        Line,    // 逐行多项式
+        Surface  // 整幅图像的多项式曲面
+    };
+
+    using Robust = SpmFlattenRobust;
+
+    static constexpr int max_order = 5;
+
+    // 每个线程任务至少处理的像素数，条带等小数据直接在调用线程中处理
+    static constexpr size_t parallel_grain_pixels = 256 * 1024;
+
+    /**
+     * @brief 缓存键中使用的处理参数标识，如 "flatten_first"、"flatten_line3"、"flatten_surface1_robust3x2.5"
+     */
+    static std::string getProcessingTag(Mode mode, int order, const Robust &robust = Robust{0}) {
+        std::string tag = (mode == Mode::Line && order == 1) ? std::string("flatten_first") :
+                          std::string(mode == Mode::Line ? "flatten_line" : "flatten_surface") + std::to_string(order);
+        if (robust.enabled()) {
+            std::ostringstream oss;
+            oss << "_robust" << robust.max_iterations << "x" << robust.threshold_sigma;
+            tag += oss.str();
+        }
+        return tag;
+    }
+
+    /**
+     * @brief 拉平处理
+     *
+     * @param data The height map view to flatten in place.
+     * @param mode Line or Surface.
+     * @param order The polynomial order, [0, max_order].
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return false if the order is out of range
+     */
+    template<typename T>
+    static bool flatten(const SpmHeightMapView<T> &data, Mode mode, int order, int max_workers = 0) {
+        return flatten(data, mode, order, Robust{0}, {}, max_workers);
+    }
+
+    /**
+     * @brief 稳健 / 掩膜拉平处理
+     *
+     * @param data The height map view to flatten in place.
+     * @param mode Line or Surface.
+     * @param order The polynomial order, [0, max_order].
+     * @param robust The robust fitting parameters, Robust{0} for a plain fit.
+     * @param mask Optional, same size as data. Only pixels with a nonzero mask value are used in the fit.
+     * @param max_workers The maximum number of worker threads, <= 0 for SpmParallel::defaultWorkerCount().
+     * @return false if the order, the robust parameters or the mask size is invalid
+     */
+    template<typename T>
+    static bool flatten(const SpmHeightMapView<T> &data, Mode mode, int order, const Robust &robust,
+                        SpmHeightMapView<const unsigned char> mask = {}, int max_workers = 0) {
+        if (order < 0 || order > max_order) {
+            std::cout << "SpmFlatten::flatten() [Error]: Order " << order << " is out of range [0, " << max_order
+                      << "]" << std::endl;
+            return false;
+        }
+        if (robust.enabled() && !(robust.threshold_sigma > 0.0)) {
+            std::cout << "SpmFlatten::flatten() [Error]: Robust threshold must be positive" << std::endl;
+            return false;
+        }
+        if (!mask.empty() && (mask.rows() != data.rows() || mask.cols() != data.cols())) {
+            std::cout << "SpmFlatten::flatten() [Error]: Mask size " << mask.rows() << " x " << mask.cols()
+                      << " does not match " << data.rows() << " x " << data.cols() << std::endl;
+            return false;
+        }
+
+        if (mode == Mode::Line) {
+            flattenLine(data, order, robust, mask, max_workers);
+        } else {
+            flattenSurface(data, order, robust, mask, max_workers);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 一阶拉平，各行按行块并行处理
+     */
+    template<typename T>
+    static void flattenFirst(const SpmHeightMapView<T> &data, int max_workers = 0) {
+        flattenLine(data, 1, Robust{0}, {}, max_workers);
+    }
+
+    /**
+     * @brief 拉平一行数据: 拟合并减去 basis.order() 阶多项式
+     *
+     * @param row The row data, basis.size() elements.
+     * @param basis The x basis of the row width.
+     * @return None
+     */
+    template<typename T>
+    static void flattenRow(T *row, const SpmPolyBasis &basis) {
+        dispatchOrder(basis.order(), [&](auto order_constant) {
+            constexpr int N = decltype(order_constant)::value;
+            double coef[N + 1];
+            projectRow<N>(row, basis, coef);
+            subtractRow<N>(row, basis, coef);
+        });
+    }
+
+private:
+    /**
+     * @brief 逐行拟合并减去 order 阶多项式
+     */
+    template<typename T>
+    static void flattenLine(const SpmHeightMapView<T> &data, int order, const Robust &robust,
+                            const SpmHeightMapView<const unsigned char> &mask, int max_workers) {
+        if (data.empty()) return;
+
+        std::shared_ptr<const SpmPolyBasis> basis = SpmPolyBasis::get(data.cols(), order);
+
+        if (!robust.enabled() && mask.empty()) {
+            forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+                for (size_t r = begin; r < end; ++r) {
+                    flattenRow(data.rowPtr((int) r), *basis);
+                }
+            });
+            return;
+        }
+
+        dispatchOrder(basis->order(), [&](auto order_constant) {
+            flattenLineRobust<decltype(order_constant)::value>(data, *basis, robust, mask, max_workers);
+        });
+    }
+
+    template<int N, typename T>
+    static void flattenLineRobust(const SpmHeightMapView<T> &data, const SpmPolyBasis &basis, const Robust &robust,
+                                  const SpmHeightMapView<const unsigned char> &mask, int max_workers) {
+        forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+            SpmFitSystem system;
+            std::vector<unsigned char> included;
+            std::vector<double> residual;
+            for (size_t r = begin; r < end; ++r) {
+                const unsigned char *mask_row = mask.empty() ? nullptr : mask.rowPtr((int) r);
+                flattenRowRobust<N>(data.rowPtr((int) r), basis, robust, mask_row, system, included, residual);
+            }
+        });
+    }
+
+    /**
+     * @brief 稳健 / 掩膜拉平一行数据，included 记录每个像素是否参与拟合，residual 为残差缓冲区
+     */
+    template<int N, typename T>
+    static void flattenRowRobust(T *row, const SpmPolyBasis &basis, const Robust &robust,
+                                 const unsigned char *mask_row, SpmFitSystem &system,
+                                 std::vector<unsigned char> &included, std::vector<double> &residual) {
+        const int cols = basis.size();
+        const double *q[N + 1];
+        for (int j = 0; j <= N; ++j) q[j] = basis.basis(j);
+
+        double phi[N + 1];
+        auto basisAt = [&](int c) {
+            phi[0] = basis.constant();
+            for (int j = 1; j <= N; ++j) phi[j] = q[j][c];
+        };
+
+        // 全部像素参与时 G 为单位矩阵，b 为各基函数与数据的内积
+        system.reset(N + 1, true);
+        projectRow<N>(row, basis, system.rhs());
+        included.assign((size_t) cols, 1);
+        int included_count = cols;
+
+        if (mask_row) {
+            for (int c = 0; c < cols; ++c) {
+                if (mask_row[c]) continue;
+                basisAt(c);
+                system.update(phi, row[c], -1.0);
+                included[c] = 0;
+                --included_count;
+            }
+        }
+
+        double coef[N + 1];
+        if (!system.solve(coef)) {
+            projectRow<N>(row, basis, coef);  // 掩膜内像素不足时退回普通拟合
+            subtractRow<N>(row, basis, coef);
+            return;
+        }
+
+        residual.resize((size_t) cols);
+        for (int iteration = 0; iteration < robust.max_iterations; ++iteration) {
+            const double offset = coef[0] * basis.constant();
+            double sum_squares = 0.0;
+            for (int c = 0; c < cols; ++c) {
+                double fit = offset;
+                for (int j = 1; j <= N; ++j) fit += coef[j] * q[j][c];
+                residual[c] = row[c] - fit;
+                sum_squares += included[c] ? residual[c] * residual[c] : 0.0;
+            }
+            double limit = robust.threshold_sigma * std::sqrt(sum_squares / std::max(included_count, 1));
+            if (!(limit > 0.0)) break;
+
+            int changed_count = 0;
+            for (int c = 0; c < cols; ++c) {
+                unsigned char include = (!mask_row || mask_row[c]) && std::fabs(residual[c]) <= limit;
+                if (include == included[c]) continue;
+
+                basisAt(c);
+                system.update(phi, row[c], include ? 1.0 : -1.0);
+                included[c] = include;
+                included_count += include ? 1 : -1;
+                ++changed_count;
+            }
+            if (changed_count == 0) break;
+
+            double next_coef[N + 1];
+            if (!system.solve(next_coef)) break;
+            std::copy(next_coef, next_coef + N + 1, coef);
+        }
+
+        subtractRow<N>(row, basis, coef);
+    }
+
+    /**
+     * @brief 拟合并减去总次数不超过 order 的二维多项式曲面
+     */
+    template<typename T>
+    static void flattenSurface(const SpmHeightMapView<T> &data, int order, const Robust &robust,
+                               const SpmHeightMapView<const unsigned char> &mask, int max_workers) {
+        if (data.empty()) return;
+
+        std::shared_ptr<const SpmPolyBasis> x_basis = SpmPolyBasis::get(data.cols(), order);
+        std::shared_ptr<const SpmPolyBasis> y_basis = SpmPolyBasis::get(data.rows(), order);
+        dispatchOrder(x_basis->order(), [&](auto order_constant) {
+            flattenSurfaceImpl<decltype(order_constant)::value>(data, order, *x_basis, *y_basis, robust, mask,
+                                                                max_workers);
+        });
+    }
+
+    template<int N, typename T>
+    static void flattenSurfaceImpl(const SpmHeightMapView<T> &data, int order, const SpmPolyBasis &x_basis,
+                                   const SpmPolyBasis &y_basis, const Robust &robust,
+                                   const SpmHeightMapView<const unsigned char> &mask, int max_workers) {
+        const int rows = data.rows();
+        const int cols = data.cols();
+
+        // 曲面项 (i, j): qx_i(c) * qy_j(r)，i + j <= order
+        std::vector<std::pair<int, int>> terms;
+        for (int i = 0; i <= x_basis.order(); ++i) {
+            for (int j = 0; j <= y_basis.order() && i + j <= order; ++j) terms.emplace_back(i, j);
+        }
+        const int term_count = (int) terms.size();
+
+        const size_t grain_rows = rowGrain(data);
+        const size_t chunk_count = (rows + grain_rows - 1) / grain_rows;
+
+        // 第一次遍历: 每行与 x 基的内积 row_coef[r][i] = sum_c(qx_i(c) * z(r, c))
+        std::vector<double> row_coef((size_t) rows * (N + 1));
+        forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r) {
+                projectRow<N>(data.rowPtr((int) r), x_basis, row_coef.data() + r * (N + 1));
+            }
+        });
+
+        // 全部像素参与时 G 为单位矩阵，b[(i, j)] = sum_r(qy_j(r) * row_coef[r][i])
+        SpmFitSystem system(term_count, true);
+        for (int t = 0; t < term_count; ++t) {
+            const double *qy = y_basis.basis(terms[t].second);
+            double sum = 0.0;
+            for (int r = 0; r < rows; ++r) sum += qy[r] * row_coef[(size_t) r * (N + 1) + terms[t].first];
+            system.rhs()[t] = sum;
+        }
+
+        std::vector<double> surface_coef(term_count);
+        std::copy(system.rhs(), system.rhs() + term_count, surface_coef.begin());
+
+        // 第 r 行的拟合值为 sum_i(b_i(r) * qx_i(c))，b_i(r) = sum_j(a[(i, j)] * qy_j(r))
+        auto rowCoef = [&](int r, double *coef) {
+            std::fill(coef, coef + N + 1, 0.0);
+            for (int t = 0; t < term_count; ++t) {
+                coef[terms[t].first] += surface_coef[t] * y_basis.basis(terms[t].second)[r];
+            }
+        };
+
+        if (robust.enabled() || !mask.empty()) {
+            const double *qx[N + 1];
+            for (int i = 0; i <= N; ++i) qx[i] = x_basis.basis(i);
+
+            auto basisAt = [&](int r, int c, double *phi) {
+                for (int t = 0; t < term_count; ++t) {
+                    phi[t] = qx[terms[t].first][c] * y_basis.basis(terms[t].second)[r];
+                }
+            };
+            auto residualAt = [&](const T *row, const double *coef, int c) {
+                double fit = 0.0;
+                for (int i = 0; i <= N; ++i) fit += coef[i] * qx[i][c];
+                return row[c] - fit;
+            };
+
+            std::vector<unsigned char> included((size_t) rows * cols, 1);
+            long long included_count = (long long) rows * cols;
+
+            // 各行块分别累加 G、b 与参与拟合像素数的变化量，再合并，返回状态变化的像素数
+            std::vector<SpmFitSystem> chunk_delta(chunk_count);
+            std::vector<long long> chunk_changed(chunk_count, 0);
+            std::vector<long long> chunk_included_delta(chunk_count, 0);
+            auto mergeDelta = [&]() {
+                long long changed = 0;
+                for (size_t k = 0; k < chunk_count; ++k) {
+                    system.add(chunk_delta[k]);
+                    changed += chunk_changed[k];
+                    included_count += chunk_included_delta[k];
+                }
+                return changed;
+            };
+
+            if (!mask.empty()) {
+                forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+                    size_t chunk = begin / grain_rows;
+                    chunk_delta[chunk].reset(term_count, false);
+                    chunk_changed[chunk] = 0;
+                    std::vector<double> phi(term_count);
+                    for (size_t r = begin; r < end; ++r) {
+                        const T *row = data.rowPtr((int) r);
+                        const unsigned char *mask_row = mask.rowPtr((int) r);
+                        for (int c = 0; c < cols; ++c) {
+                            if (mask_row[c]) continue;
+                            basisAt((int) r, c, phi.data());
+                            chunk_delta[chunk].update(phi.data(), row[c], -1.0);
+                            included[r * cols + c] = 0;
+                            ++chunk_changed[chunk];
+                        }
+                    }
+                    chunk_included_delta[chunk] = -chunk_changed[chunk];
+                });
+                mergeDelta();
+
+                // 掩膜内像素不足时保留普通拟合的系数，不再迭代
+                if (!system.solve(surface_coef.data())) included.clear();
+            }
+
+            for (int iteration = 0; iteration < robust.max_iterations && !included.empty(); ++iteration) {
+                std::vector<double> chunk_sum_squares(chunk_count, 0.0);
+                forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+                    double coef[N + 1];
+                    double sum_squares = 0.0;
+                    for (size_t r = begin; r < end; ++r) {
+                        const T *row = data.rowPtr((int) r);
+                        const unsigned char *included_row = included.data() + r * cols;
+                        rowCoef((int) r, coef);
+                        for (int c = 0; c < cols; ++c) {
+                            if (!included_row[c]) continue;
+                            double residual = residualAt(row, coef, c);
+                            sum_squares += residual * residual;
+                        }
+                    }
+                    chunk_sum_squares[begin / grain_rows] = sum_squares;
+                });
+
+                double sum_squares = 0.0;
+                for (double chunk_sum : chunk_sum_squares) sum_squares += chunk_sum;
+                double limit = robust.threshold_sigma * std::sqrt(sum_squares / (double) std::max(included_count, 1LL));
+                if (!(limit > 0.0)) break;
+
+                forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+                    size_t chunk = begin / grain_rows;
+                    chunk_delta[chunk].reset(term_count, false);
+                    chunk_changed[chunk] = 0;
+                    long long included_delta = 0;
+                    double coef[N + 1];
+                    std::vector<double> phi(term_count);
+                    for (size_t r = begin; r < end; ++r) {
+                        const T *row = data.rowPtr((int) r);
+                        const unsigned char *mask_row = mask.empty() ? nullptr : mask.rowPtr((int) r);
+                        unsigned char *included_row = included.data() + r * cols;
+                        rowCoef((int) r, coef);
+                        for (int c = 0; c < cols; ++c) {
+                            unsigned char include =
+                                    (!mask_row || mask_row[c]) && std::fabs(residualAt(row, coef, c)) <= limit;
+                            if (include == included_row[c]) continue;
+
+                            basisAt((int) r, c, phi.data());
+                            chunk_delta[chunk].update(phi.data(), row[c], include ? 1.0 : -1.0);
+                            included_row[c] = include;
+                            included_delta += include ? 1 : -1;
+                            ++chunk_changed[chunk];
+                        }
+                    }
+                    chunk_included_delta[chunk] = included_delta;
+                });
+
+                if (mergeDelta() == 0) break;
+                if (!system.solve(surface_coef.data())) break;
+            }
+        }
+
+        // 第二次遍历: 减去拟合值
+        forEachRowRange(data, max_workers, [&](size_t begin, size_t end) {
+            double coef[N + 1];
+            for (size_t r = begin; r < end; ++r) {
+                rowCoef((int) r, coef);
+                subtractRow<N>(data.rowPtr((int) r), x_basis, coef);
+            }
+        });
+    }
+
+    template<typename T>
+    static size_t rowGrain(const SpmHeightMapView<T> &data) {
+        return std::max<size_t>(1, parallel_grain_pixels / (size_t) data.cols());
+    }
+
+    template<typename T, typename Fn>
+    static void forEachRowRange(const SpmHeightMapView<T> &data, int max_workers, Fn &&fn) {
+        SpmParallel::forEachRange((size_t) data.rows(), rowGrain(data), max_workers, fn);
+    }
+
+    /**
+     * @brief 将运行时的阶数转为编译期常量，fn(std::integral_constant<int, N>)
+     */
+    template<typename Fn>
+    static void dispatchOrder(int order, Fn &&fn) {
+        static_assert(max_order == 5, "Update dispatchOrder() when changing max_order");
+        switch (order) {
+            case 0: fn(std::integral_constant<int, 0>{}); break;
+            case 1: fn(std::integral_constant<int, 1>{}); break;
+            case 2: fn(std::integral_constant<int, 2>{}); break;
+            case 3: fn(std::integral_constant<int, 3>{}); break;
+            case 4: fn(std::integral_constant<int, 4>{}); break;
+            default: fn(std::integral_constant<int, 5>{}); break;
+        }
+    }
+
+    /**
+     * @brief 一次遍历计算 coef[j] = sum(q_j * row)，j = 0 ... N
+     */
+    template<int N, typename T>
+    static void projectRow(const T *row, const SpmPolyBasis &basis, double *coef) {
+        static_assert(std::is_same_v<T, double> || std::is_same_v<T, float>, "Data must be double or float");
+
+        const int cols = basis.size();
+        const double *q[N + 1];
+        for (int j = 0; j <= N; ++j) q[j] = basis.basis(j);
+
+        double sum[N + 1] = {};
+        int c = 0;
+
+#ifdef SPM_FLATTEN_SSE2
+        __m128d sum_pd[N + 1];
+        for (int j = 0; j <= N; ++j) sum_pd[j] = _mm_setzero_pd();
+
+        if constexpr (std::is_same_v<T, double>) {
+            for (; c + 2 <= cols; c += 2) {
+                accumulatePair<N>(_mm_loadu_pd(row + c), q, c, sum_pd);
+            }
+        } else {
+            for (; c + 4 <= cols; c += 4) {
+                __m128 z = _mm_loadu_ps(row + c);
+                accumulatePair<N>(_mm_cvtps_pd(z), q, c, sum_pd);
+                accumulatePair<N>(_mm_cvtps_pd(_mm_movehl_ps(z, z)), q, c + 2, sum_pd);
+            }
+        }
+
+        for (int j = 0; j <= N; ++j) sum[j] = horizontalSum(sum_pd[j]);
+#endif
+
+        for (; c < cols; ++c) {
+            double z = row[c];
+            sum[0] += z;
+            for (int j = 1; j <= N; ++j) sum[j] += q[j][c] * z;
+        }
+
+        coef[0] = sum[0] * basis.constant();  // q_0 为常数，只需累加 sum(z)
+        for (int j = 1; j <= N; ++j) coef[j] = sum[j];
+    }
+
+    /**
+     * @brief 一次遍历减去拟合值 sum(coef[j] * q_j)
+     */
+    template<int N, typename T>
+    static void subtractRow(T *row, const SpmPolyBasis &basis, const double *coef) {
+        const int cols = basis.size();
+        const double *q[N + 1];
+        for (int j = 0; j <= N; ++j) q[j] = basis.basis(j);
+
+        const double offset = coef[0] * basis.constant();
+        int c = 0;
+
+#ifdef SPM_FLATTEN_SSE2
+        __m128d coef_pd[N + 1];
+        coef_pd[0] = _mm_set1_pd(offset);
+        for (int j = 1; j <= N; ++j) coef_pd[j] = _mm_set1_pd(coef[j]);
+
+        if constexpr (std::is_same_v<T, double>) {
+            for (; c + 2 <= cols; c += 2) {
+                _mm_storeu_pd(row + c, _mm_sub_pd(_mm_loadu_pd(row + c), fitPair<N>(coef_pd, q, c)));
+            }
+        } else {
+            for (; c + 4 <= cols; c += 4) {
+                __m128 z = _mm_loadu_ps(row + c);
+                __m128d z_0 = _mm_sub_pd(_mm_cvtps_pd(z), fitPair<N>(coef_pd, q, c));
+                __m128d z_1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(z, z)), fitPair<N>(coef_pd, q, c + 2));
+                _mm_storeu_ps(row + c, _mm_movelh_ps(_mm_cvtpd_ps(z_0), _mm_cvtpd_ps(z_1)));
+            }
+        }
+#endif
+
+        for (; c < cols; ++c) {
+            double fit = offset;
+            for (int j = 1; j <= N; ++j) fit += coef[j] * q[j][c];
+            row[c] = (T) (row[c] - fit);
+        }
+    }
+
+#ifdef SPM_FLATTEN_SSE2
+    template<int N>
+    static void accumulatePair(__m128d z, const double *const *q, int c, __m128d *sum_pd) {
+        sum_pd[0] = _mm_add_pd(sum_pd[0], z);
+        for (int j = 1; j <= N; ++j) {
+            sum_pd[j] = _mm_add_pd(sum_pd[j], _mm_mul_pd(_mm_loadu_pd(q[j] + c), z));
+        }
+    }
+
+    template<int N>
+    static __m128d fitPair(const __m128d *coef_pd, const double *const *q, int c) {
+        __m128d fit = coef_pd[0];
+        for (int j = 1; j <= N; ++j) {
+            fit = _mm_add_pd(fit, _mm_mul_pd(coef_pd[j], _mm_loadu_pd(q[j] + c)));
+        }
+        return fit;
+    }
+
+    static double horizontalSum(__m128d value) {
+        return _mm_cvtsd_f64(_mm_add_sd(value, _mm_unpackhi_pd(value, value)));
+    }
+#endif
+};
+
+
+#endif //SPM_FLATTEN_HPP
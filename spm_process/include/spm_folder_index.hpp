@@ -0,0 +1,467 @@
+#ifndef SPM_FOLDER_INDEX_HPP
+#define SPM_FOLDER_INDEX_HPP
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "spm_file.hpp"
+#include "spm_parallel.hpp"
+#include "spm_reader.hpp"
+
+
+/**
+ * @brief 文件夹索引中的一个文件
+ */
+struct SpmFolderIndexEntry {
+    std::string relative_path;  // 相对于根目录的 UTF-8 路径
+    unsigned long long file_size{};
+    long long file_mtime{};
+    bool valid = false;  // 文件头是否可以解析，不可解析的文件同样记录，避免每次更新时重复读取
+    SpmProbeInfo probe_info;
+
+    /**
+     * @brief 图块在样品台坐标中的范围 (nm): 中心为 Engage Pos + Offset，边长为 Scan Size
+     */
+    long long centerXNM() const { return probe_info.engage_x_pos_nm + probe_info.x_offset_nm; }
+
+    long long centerYNM() const { return probe_info.engage_y_pos_nm + probe_info.y_offset_nm; }
+
+    long long xMinNM() const { return centerXNM() - probe_info.scan_size / 2; }
+
+    long long xMaxNM() const { return xMinNM() + probe_info.scan_size; }
+
+    long long yMinNM() const { return centerYNM() - probe_info.scan_size / 2; }
+
+    long long yMaxNM() const { return yMinNM() + probe_info.scan_size; }
+};
+
+
+/**
+ * @brief SPM 文件夹元数据索引
+ *
+ * 递归扫描根目录下的 SPM 文件（扩展名为 .spm 或 Bruker 的三位数字序号，如 .001），并行读取文件头，
+ * 将进针位置、偏移、扫描尺寸、通道与采集时间等信息保存到本地索引文件中。再次更新时，大小与修改时间未变化的文件
+ * 直接复用索引中的信息，只读取新增或变化的文件。
+ *
+ * 索引文件为二进制格式:
+ *   Header: magic "SPMINDEX", version, entry count, root path
+ *   Entry x n: relative path, file size, file mtime, valid, probe info
+ * 文件中保存的是相对路径，根目录整体移动后索引仍然有效。
+ *
+ * 非线程安全。
+ */
+class SpmFolderIndex {
+public:
+    enum class QueryMode {
+        Contains,   // 图块完全位于矩形内
+        Intersects  // 图块与矩形相交
+    };
+
+    struct UpdateStats {
+        size_t unchanged = 0;  // 复用索引的文件数
+        size_t probed = 0;     // 重新读取文件头的文件数
+        size_t removed = 0;    // 已不存在的文件数
+    };
+
+    /**
+     * @param root_dir The UTF-8 root directory to scan.
+     * @param index_path The UTF-8 index file path, e.g. in the application cache directory.
+     */
+    SpmFolderIndex(const std::string &root_dir, const std::string &index_path)
+            : m_root_dir(SpmFile::fromUtf8(root_dir)), m_index_path(SpmFile::fromUtf8(index_path)) {}
+
+    ~SpmFolderIndex() = default;
+
+public:
+    /**
+     * @brief 读取索引文件，文件不存在、格式不符或根目录不同时索引为空
+     *
+     * @return true if the index file is loaded
+     */
+    bool load() {
+        m_entry_list.clear();
+        rebuildBounds();
+
+        SpmFile index_file;
+        if (!index_file.open(m_index_path)) return false;
+
+        std::string buffer((size_t) index_file.size(), '\0');
+        if (index_file.readAt(0, buffer.data(), buffer.size()) != buffer.size()) return false;
+        index_file.close();
+
+        Reader reader(buffer);
+        char file_magic[sizeof(magic)];
+        uint32_t file_version;
+        uint64_t entry_count;
+        std::string root_str;
+        if (!reader.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0 ||
+            !reader.read(file_version) || file_version != version || !reader.read(entry_count) ||
+            !reader.read(root_str)) {
+            std::cout << "SpmFolderIndex::load() [Error]: Invalid index file: " << m_index_path.u8string()
+                      << std::endl;
+            return false;
+        }
+        if (root_str != m_root_dir.u8string()) return false;  // 其他目录的索引
+
+        std::vector<SpmFolderIndexEntry> entry_list;
+        entry_list.reserve((size_t) std::min<uint64_t>(entry_count, buffer.size()));
+        for (uint64_t i = 0; i < entry_count; ++i) {
+            SpmFolderIndexEntry entry;
+            if (!readEntry(reader, entry)) {
+                std::cout << "SpmFolderIndex::load() [Error]: Truncated index file: " << m_index_path.u8string()
+                          << std::endl;
+                return false;
+            }
+            entry_list.emplace_back(std::move(entry));
+        }
+
+        m_entry_list = std::move(entry_list);
+        rebuildBounds();
+
+        return true;
+    }
+
+    /**
+     * @brief 将索引写入索引文件（先写入临时文件再重命名）
+     *
+     * @return true if successful
+     */
+    bool save() const {
+        std::string buffer;
+        Writer writer(buffer);
+        writer.write(magic, sizeof(magic));
+        writer.write(version);
+        writer.write((uint64_t) m_entry_list.size());
+        writer.write(m_root_dir.u8string());
+        for (auto &entry : m_entry_list) {
+            writeEntry(writer, entry);
+        }
+
+        std::error_code ec;
+        if (m_index_path.has_parent_path()) std::filesystem::create_directories(m_index_path.parent_path(), ec);
+
+        std::filesystem::path temp_path = m_index_path;
+        temp_path += ".tmp";
+        {
+            std::ofstream index_file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!index_file.is_open()) {
+                std::cout << "SpmFolderIndex::save() [Error]: Failed to create index file: " << temp_path.u8string()
+                          << std::endl;
+                return false;
+            }
+
+            index_file.write(buffer.data(), (std::streamsize) buffer.size());
+            if (!index_file.good()) {
+                index_file.close();
+                std::filesystem::remove(temp_path, ec);
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temp_path, m_index_path, ec);
+        if (ec) {
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief 递归扫描根目录并更新索引，只并行读取新增或大小 / 修改时间变化的文件，不写入索引文件
+     *
+     * @param max_workers The maximum number of worker threads, <= 0 for hardware concurrency.
+     * @param stats The update statistics, may be nullptr.
+     * @return false if the root directory cannot be scanned
+     */
+    bool update(int max_workers = 0, UpdateStats *stats = nullptr) {
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator dir_iterator(
+                m_root_dir, std::filesystem::directory_options::skip_permission_denied, ec);
+        if (ec) {
+            std::cout << "SpmFolderIndex::update() [Error]: Failed to scan directory: " << m_root_dir.u8string()
+                      << std::endl;
+            return false;
+        }
+
+        std::unordered_map<std::string, size_t> old_index_map;
+        for (size_t i = 0; i < m_entry_list.size(); ++i) {
+            old_index_map.emplace(m_entry_list[i].relative_path, i);
+        }
+
+        // 按目录顺序收集文件，大小与修改时间未变化的文件直接复用
+        std::vector<SpmFolderIndexEntry> entry_list;
+        std::vector<size_t> probe_index_list;
+        size_t matched_count = 0;
+        UpdateStats update_stats;
+        for (auto end = std::filesystem::recursive_directory_iterator(); dir_iterator != end;
+             dir_iterator.increment(ec)) {
+            if (ec) break;
+
+            const std::filesystem::directory_entry &dir_entry = *dir_iterator;
+            if (!dir_entry.is_regular_file(ec) || !isSpmFileName(dir_entry.path())) continue;
+
+            SpmFolderIndexEntry entry;
+            entry.relative_path = dir_entry.path().lexically_relative(m_root_dir).u8string();
+            entry.file_size = dir_entry.file_size(ec);
+            if (ec) continue;
+            entry.file_mtime = (long long) dir_entry.last_write_time(ec).time_since_epoch().count();
+            if (ec) continue;
+
+            auto it = old_index_map.find(entry.relative_path);
+            if (it != old_index_map.end()) matched_count += 1;
+            if (it != old_index_map.end() && m_entry_list[it->second].file_size == entry.file_size &&
+                m_entry_list[it->second].file_mtime == entry.file_mtime) {
+                entry_list.emplace_back(std::move(m_entry_list[it->second]));
+                update_stats.unchanged += 1;
+            } else {
+                probe_index_list.emplace_back(entry_list.size());
+                entry_list.emplace_back(std::move(entry));
+            }
+        }
+        update_stats.probed = probe_index_list.size();
+        update_stats.removed = m_entry_list.size() - matched_count;
+
+        // 并行读取文件头
+        SpmParallel::forEachIndex(probe_index_list.size(), max_workers, [&](size_t i) {
+            SpmFolderIndexEntry &entry = entry_list[probe_index_list[i]];
+            SpmReader spm_reader((m_root_dir / SpmFile::fromUtf8(entry.relative_path)).u8string());
+            entry.valid = spm_reader.probe(entry.probe_info);
+        });
+
+        m_entry_list = std::move(entry_list);
+        rebuildBounds();
+
+        if (stats) *stats = update_stats;
+
+        return true;
+    }
+
+    /**
+     * @brief 查询样品台坐标矩形内的图块 (nm)，只遍历紧凑保存的范围数组
+     *
+     * @param x_min_nm, y_min_nm, x_max_nm, y_max_nm The rectangle in stage coordinates.
+     * @param mode Whether the tile must be contained in or only intersect the rectangle.
+     * @param image_type The required channel, empty for any.
+     * @return the matched entries, valid until the next load() / update()
+     */
+    std::vector<const SpmFolderIndexEntry *> queryRect(long long x_min_nm, long long y_min_nm,
+                                                       long long x_max_nm, long long y_max_nm,
+                                                       QueryMode mode = QueryMode::Contains,
+                                                       const std::string &image_type = "") const {
+        std::vector<const SpmFolderIndexEntry *> result;
+        for (size_t i = 0; i < m_bounds_list.size(); ++i) {
+            const Bounds &bounds = m_bounds_list[i];
+            bool matched;
+            if (mode == QueryMode::Contains) {
+                matched = bounds.x_min >= x_min_nm && bounds.x_max <= x_max_nm &&
+                          bounds.y_min >= y_min_nm && bounds.y_max <= y_max_nm;
+            } else {
+                matched = bounds.x_min <= x_max_nm && bounds.x_max >= x_min_nm &&
+                          bounds.y_min <= y_max_nm && bounds.y_max >= y_min_nm;
+            }
+            if (!matched) continue;
+
+            const SpmFolderIndexEntry &entry = m_entry_list[bounds.entry_index];
+            if (!image_type.empty() && !entry.probe_info.hasChannel(image_type)) continue;
+
+            result.emplace_back(&entry);
+        }
+
+        return result;
+    }
+
+    /**
+     * @brief 索引中文件的 UTF-8 完整路径
+     */
+    std::string getSpmPath(const SpmFolderIndexEntry &entry) const {
+        return (m_root_dir / SpmFile::fromUtf8(entry.relative_path)).u8string();
+    }
+
+    const std::vector<SpmFolderIndexEntry> &getEntryList() const { return m_entry_list; }
+
+    size_t size() const { return m_entry_list.size(); }
+
+    std::string getRootDir() const { return m_root_dir.u8string(); }
+
+    std::string getIndexPath() const { return m_index_path.u8string(); }
+
+    /**
+     * @brief 是否为 SPM 文件名: 扩展名为 .spm（不区分大小写）或三位数字（如 .001）
+     */
+    static bool isSpmFileName(const std::filesystem::path &path) {
+        std::string extension = path.extension().string();
+        if (extension.size() != 4) return false;
+
+        std::string lower_extension = extension;
+        std::transform(lower_extension.begin(), lower_extension.end(), lower_extension.begin(),
+                       [](unsigned char ch) { return (char) std::tolower(ch); });
+        if (lower_extension == ".spm") return true;
+
+        return std::all_of(extension.begin() + 1, extension.end(),
+                           [](unsigned char ch) { return std::isdigit(ch) != 0; });
+    }
+
+private:
+    struct Bounds {
+        long long x_min;
+        long long y_min;
+        long long x_max;
+        long long y_max;
+        size_t entry_index;
+    };
+
+    // 二进制写入，整数按本机字节序
+    class Writer {
+    public:
+        explicit Writer(std::string &buffer)
+                : m_buffer(buffer) {}
+
+        void write(const void *data, size_t size) {
+            m_buffer.append(static_cast<const char *>(data), size);
+        }
+
+        template<typename T>
+        void write(T value) {
+            static_assert(std::is_arithmetic_v<T>, "Value must be arithmetic");
+            write(&value, sizeof(T));
+        }
+
+        void write(const std::string &str) {
+            write((uint32_t) str.size());
+            write(str.data(), str.size());
+        }
+
+    private:
+        std::string &m_buffer;
+    };
+
+    // 二进制读取，越界时返回 false
+    class Reader {
+    public:
+        explicit Reader(const std::string &buffer)
+                : m_buffer(buffer) {}
+
+        bool read(void *data, size_t size) {
+            if (size > m_buffer.size() - m_pos) return false;
+            std::memcpy(data, m_buffer.data() + m_pos, size);
+            m_pos += size;
+            return true;
+        }
+
+        template<typename T>
+        bool read(T &value) {
+            static_assert(std::is_arithmetic_v<T>, "Value must be arithmetic");
+            return read(&value, sizeof(T));
+        }
+
+        bool read(std::string &str) {
+            uint32_t size;
+            if (!read(size) || size > m_buffer.size() - m_pos) return false;
+            str.assign(m_buffer.data() + m_pos, size);
+            m_pos += size;
+            return true;
+        }
+
+    private:
+        const std::string &m_buffer;
+        size_t m_pos = 0;
+    };
+
+    static void writeEntry(Writer &writer, const SpmFolderIndexEntry &entry) {
+        const SpmProbeInfo &info = entry.probe_info;
+        writer.write(entry.relative_path);
+        writer.write((uint64_t) entry.file_size);
+        writer.write((int64_t) entry.file_mtime);
+        writer.write((uint8_t) entry.valid);
+        writer.write((uint32_t) info.scan_size);
+        writer.write((int64_t) info.engage_x_pos_nm);
+        writer.write((int64_t) info.engage_y_pos_nm);
+        writer.write((int32_t) info.x_offset_nm);
+        writer.write((int32_t) info.y_offset_nm);
+        writer.write(info.date);
+        writer.write((uint32_t) info.channel_list.size());
+        for (auto &channel : info.channel_list) {
+            writer.write(channel.image_type);
+            writer.write((int32_t) channel.rows);
+            writer.write((int32_t) channel.cols);
+            writer.write((int32_t) channel.bytes_per_pixel);
+            writer.write((uint32_t) channel.data_offset);
+            writer.write((uint32_t) channel.data_length);
+        }
+    }
+
+    static bool readEntry(Reader &reader, SpmFolderIndexEntry &entry) {
+        SpmProbeInfo &info = entry.probe_info;
+        uint64_t file_size;
+        int64_t file_mtime, engage_x_pos_nm, engage_y_pos_nm;
+        uint8_t valid;
+        uint32_t scan_size, channel_count;
+        int32_t x_offset_nm, y_offset_nm;
+        if (!reader.read(entry.relative_path) || !reader.read(file_size) || !reader.read(file_mtime) ||
+            !reader.read(valid) || !reader.read(scan_size) || !reader.read(engage_x_pos_nm) ||
+            !reader.read(engage_y_pos_nm) || !reader.read(x_offset_nm) || !reader.read(y_offset_nm) ||
+            !reader.read(info.date) || !reader.read(channel_count)) {
+            return false;
+        }
+
+        entry.file_size = file_size;
+        entry.file_mtime = file_mtime;
+        entry.valid = valid != 0;
+        info.scan_size = scan_size;
+        info.engage_x_pos_nm = engage_x_pos_nm;
+        info.engage_y_pos_nm = engage_y_pos_nm;
+        info.x_offset_nm = x_offset_nm;
+        info.y_offset_nm = y_offset_nm;
+
+        for (uint32_t c = 0; c < channel_count; ++c) {
+            SpmProbeInfo::Channel channel;
+            int32_t rows, cols, bytes_per_pixel;
+            uint32_t data_offset, data_length;
+            if (!reader.read(channel.image_type) || !reader.read(rows) || !reader.read(cols) ||
+                !reader.read(bytes_per_pixel) || !reader.read(data_offset) || !reader.read(data_length)) {
+                return false;
+            }
+
+            channel.rows = rows;
+            channel.cols = cols;
+            channel.bytes_per_pixel = bytes_per_pixel;
+            channel.data_offset = data_offset;
+            channel.data_length = data_length;
+            info.channel_list.emplace_back(std::move(channel));
+        }
+
+        return true;
+    }
+
+    void rebuildBounds() {
+        m_bounds_list.clear();
+        for (size_t i = 0; i < m_entry_list.size(); ++i) {
+            const SpmFolderIndexEntry &entry = m_entry_list[i];
+            if (!entry.valid) continue;
+
+            m_bounds_list.push_back({entry.xMinNM(), entry.yMinNM(), entry.xMaxNM(), entry.yMaxNM(), i});
+        }
+    }
+
+private:
+    static constexpr char magic[8] = {'S', 'P', 'M', 'I', 'N', 'D', 'E', 'X'};
+    static constexpr uint32_t version = 2;  // 2: Scan Size 与 X/Y Offset 按单位换算为 nm
+
+    std::filesystem::path m_root_dir;
+    std::filesystem::path m_index_path;
+    std::vector<SpmFolderIndexEntry> m_entry_list;
+    std::vector<Bounds> m_bounds_list;  // 可解析文件的范围，查询时只遍历该数组
+};
+
+
+#endif //SPM_FOLDER_INDEX_HPP
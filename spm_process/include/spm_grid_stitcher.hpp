@@ -0,0 +1,537 @@
+#ifndef SPM_GRID_STITCHER_HPP
+#define SPM_GRID_STITCHER_HPP
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "opencv2/opencv.hpp"
+
+#include "spm_height_map.hpp"
+#include "spm_parallel.hpp"
+#include "spm_reader.hpp"
+
+
+// 平移拼接参数（SpmGridStitcher::Params）
+struct SpmGridStitchParams {
+    int search_radius = 32;         // 配准时在预测位置周围搜索的半径（像素），应大于载物台定位误差；朝图块外侧的搜索范围另受 重叠宽度 - min_overlap 限制
+    int min_overlap = 16;           // 参与配准的最小重叠宽度（像素）
+    double min_overlap_span = 0.5;  // 重叠区域较长的一边至少为图块边长的该比例，排除只在角上重叠的图块对（配准不可靠）
+    double min_correlation = 0.5;   // 接受配准结果的最小归一化相关系数
+    double max_residual = 3.0;      // 全局求解后配准结果与求解位置之差超过该值（像素）时剔除该配准结果
+    double prior_weight = 0.001;    // 预测位置的权重（配准结果以相关系数为权重），保证方程组正定
+    double max_canvas_area_ratio = 16.0;  // 画布面积超过图块面积之和的该倍数时视为求解失败，避免分配过大的画布
+    bool level_tiles = true;        // 按重叠区域的高度差校正各图块的整体高度
+    int feather = 32;               // 重叠区域羽化过渡的宽度（像素），0 为直接平均
+    bool stage_y_up = true;         // 载物台 Y 坐标向上增大（图像行号向下增大）
+    int max_workers = 0;            // <= 0 for SpmParallel::defaultWorkerCount()
+};
+
+
+/**
+ * @brief 只含平移的网格拼接
+ *
+ * SPM 图块之间只有 XY 平移，且载物台坐标给出了近似位置，无需 cv::Stitcher 的特征匹配、光束法平差、
+ * 球面投影与多频段融合:
+ *   1. 由进针位置 + 扫描偏移与扫描尺寸预测各图块在像素坐标中的位置（predictPlacement()）
+ *   2. 对预测位置相互重叠的图块对，在预测位置周围 search_radius 内以归一化互相关（matchTemplate）配准
+ *   3. 以相关系数为权重，对全部配准结果做最小二乘求解各图块位置（同时求解高度偏移），逐个剔除残差过大的配准结果
+ *   4. 按求解位置将各图块羽化叠加到浮点画布上
+ *
+ * 有图块未通过有效的配准结果与其他图块连通，或画布面积异常时 stitch() 返回 false，由调用方改用 cv::Stitcher。
+ *
+ * 配准只在重叠条带上进行，图块对的数量与图块数成正比，各图块对与画布各行块并行处理。
+ */
+class SpmGridStitcher {
+private:
+    SpmGridStitcher() = default;
+
+    ~SpmGridStitcher() = default;
+
+public:
+    using Params = SpmGridStitchParams;
+
+    /**
+     * @brief 由 SPM 文件头中的进针位置、扫描偏移与扫描尺寸预测各图块左上角的像素坐标
+     *
+     * @param spm_reader_list The SPM readers, the first image of each reader is used.
+     * @param predicted_list The predicted top-left positions in pixels, the minimum is moved to (0, 0).
+     * @param stage_y_up true if the stage Y axis points up (image rows grow downwards).
+     * @return false if the metadata is missing, the pixel sizes differ or all tiles are predicted at the same position
+     */
+    static bool predictPlacement(std::vector<SpmReader> &spm_reader_list, std::vector<cv::Point2d> &predicted_list,
+                                 bool stage_y_up = true) {
+        predicted_list.clear();
+        if (spm_reader_list.empty()) return false;
+
+        double pixel_size_nm = 0;
+        for (auto &spm_reader : spm_reader_list) {
+            SpmImage &spm_image = spm_reader.getImageSingle();
+            if (spm_image.getScanSize() <= 0 || spm_image.getCols() <= 0 || spm_image.getRows() <= 0) {
+                std::cout << "SpmGridStitcher::predictPlacement() [Error]: Missing scan size: "
+                          << spm_reader.getSpmPath() << std::endl;
+                return false;
+            }
+
+            double tile_pixel_size_nm = (double) spm_image.getScanSize() / spm_image.getCols();
+            if (pixel_size_nm == 0) pixel_size_nm = tile_pixel_size_nm;
+            if (std::abs(tile_pixel_size_nm - pixel_size_nm) > 1e-6 * pixel_size_nm) {
+                std::cout << "SpmGridStitcher::predictPlacement() [Error]: Pixel size " << tile_pixel_size_nm
+                          << " nm differs from " << pixel_size_nm << " nm: " << spm_reader.getSpmPath() << std::endl;
+                return false;
+            }
+
+            // 扫描中心 = 进针位置 + 扫描偏移
+            double center_x_nm = (double) spm_reader.getEngageXPosNM() + spm_reader.getXOffsetNM();
+            double center_y_nm = (double) spm_reader.getEngageYPosNM() + spm_reader.getYOffsetNM();
+            double x = center_x_nm / pixel_size_nm - spm_image.getCols() / 2.0;
+            double y = (stage_y_up ? -center_y_nm : center_y_nm) / pixel_size_nm - spm_image.getRows() / 2.0;
+            predicted_list.emplace_back(x, y);
+        }
+
+        cv::Point2d min_position = predicted_list[0];
+        cv::Point2d max_position = predicted_list[0];
+        for (const auto &position : predicted_list) {
+            min_position.x = std::min(min_position.x, position.x);
+            min_position.y = std::min(min_position.y, position.y);
+            max_position.x = std::max(max_position.x, position.x);
+            max_position.y = std::max(max_position.y, position.y);
+        }
+        if (predicted_list.size() > 1 && max_position.x - min_position.x < 1 && max_position.y - min_position.y < 1) {
+            std::cout << "SpmGridStitcher::predictPlacement() [Error]: All tiles are at the same stage position."
+                      << std::endl;
+            predicted_list.clear();
+            return false;
+        }
+
+        for (auto &position : predicted_list) position -= min_position;
+        return true;
+    }
+
+    /**
+     * @brief 配准并拼接图块
+     *
+     * @param image_list The single channel CV_32F or CV_64F tiles with the same pixel size.
+     * @param predicted_list The predicted top-left positions in pixels, see predictPlacement().
+     * @param canvas The stitched image, pixels not covered by any tile are set to the minimum value.
+     * @param params The stitching parameters.
+     * @param placement_list If not null, receives the final top-left position of each tile in the canvas.
+     * @return false if the input is invalid, the tiles are not all connected by valid registrations or the canvas
+     *         area exceeds max_canvas_area_ratio times the summed tile area
+     */
+    static bool stitch(const std::vector<cv::Mat> &image_list, const std::vector<cv::Point2d> &predicted_list,
+                       SpmHeightMap<double> &canvas, const Params &params = Params(),
+                       std::vector<cv::Point> *placement_list = nullptr) {
+        const int tile_count = (int) image_list.size();
+        if (tile_count == 0 || predicted_list.size() != image_list.size()) {
+            std::cout << "SpmGridStitcher::stitch() [Error]: " << tile_count << " tiles, "
+                      << predicted_list.size() << " predicted positions." << std::endl;
+            return false;
+        }
+        for (int i = 0; i < tile_count; ++i) {
+            const cv::Mat &image = image_list[i];
+            if (image.empty() || image.channels() != 1 || (image.depth() != CV_32F && image.depth() != CV_64F)) {
+                std::cout << "SpmGridStitcher::stitch() [Error]: Tile " << i
+                          << " must be a non-empty single channel CV_32F or CV_64F image." << std::endl;
+                return false;
+            }
+        }
+
+        std::vector<cv::Point> predicted_px_list(tile_count);
+        for (int i = 0; i < tile_count; ++i) {
+            predicted_px_list[i] = {(int) std::lround(predicted_list[i].x), (int) std::lround(predicted_list[i].y)};
+        }
+
+        // 预测位置沿边相互重叠的图块对
+        std::vector<Pair> pair_list;
+        for (int i = 0; i < tile_count; ++i) {
+            cv::Rect rect_i(predicted_px_list[i], image_list[i].size());
+            for (int j = i + 1; j < tile_count; ++j) {
+                cv::Rect overlap = rect_i & cv::Rect(predicted_px_list[j], image_list[j].size());
+                if (overlap.width < params.min_overlap || overlap.height < params.min_overlap) continue;
+
+                double span = std::max((double) overlap.width / std::min(image_list[i].cols, image_list[j].cols),
+                                       (double) overlap.height / std::min(image_list[i].rows, image_list[j].rows));
+                if (span >= params.min_overlap_span) {
+                    Pair pair;
+                    pair.i = i;
+                    pair.j = j;
+                    pair_list.push_back(pair);
+                }
+            }
+        }
+
+        SpmParallel::forEachIndex(pair_list.size(), params.max_workers, [&](size_t k) {
+            Pair &pair = pair_list[k];
+            pair.valid = registerPair(image_list[pair.i], image_list[pair.j],
+                                      predicted_px_list[pair.j] - predicted_px_list[pair.i], params, pair);
+        });
+
+        int limited_count = 0, min_search_range = params.search_radius;
+        for (const auto &pair : pair_list) {
+            if (pair.search_range >= params.search_radius) continue;
+
+            ++limited_count;
+            min_search_range = std::min(min_search_range, pair.search_range);
+        }
+        if (limited_count > 0) {
+            std::cout << "SpmGridStitcher::stitch() [Warning]: Overlap too narrow for search_radius "
+                      << params.search_radius << " in " << limited_count << " of " << pair_list.size()
+                      << " pairs, search limited to " << min_search_range << " px." << std::endl;
+        }
+
+        // 全局求解位置与高度偏移
+        cv::Mat solution;
+        if (!solvePlacement(pair_list, predicted_px_list, params, solution)) {
+            std::cout << "SpmGridStitcher::stitch() [Error]: Failed to solve tile placement." << std::endl;
+            return false;
+        }
+
+        // 未连通的图块只由预测位置约束，其位置与高度偏移都不可靠
+        int component_count = countComponents(pair_list, tile_count);
+        if (component_count > 1) {
+            std::cout << "SpmGridStitcher::stitch() [Error]: Tiles form " << component_count
+                      << " groups not connected by valid registrations." << std::endl;
+            return false;
+        }
+
+        // 整体平移不影响拼接结果，先消去各位置共同的小数部分再取整，避免小数部分接近 0.5 时相邻图块取整方向不同
+        std::vector<double> x_list(tile_count), y_list(tile_count);
+        for (int i = 0; i < tile_count; ++i) {
+            x_list[i] = solution.at<double>(i, 0);
+            y_list[i] = solution.at<double>(i, 1);
+        }
+        roundToCommonGrid(x_list);
+        roundToCommonGrid(y_list);
+
+        // 画布尺寸先以浮点数计算，异常的求解结果不会导致整数溢出或分配过大的画布
+        double min_x = HUGE_VAL, min_y = HUGE_VAL, max_x = -HUGE_VAL, max_y = -HUGE_VAL, tile_area = 0;
+        for (int i = 0; i < tile_count; ++i) {
+            min_x = std::min(min_x, x_list[i]);
+            min_y = std::min(min_y, y_list[i]);
+            max_x = std::max(max_x, x_list[i] + image_list[i].cols);
+            max_y = std::max(max_y, y_list[i] + image_list[i].rows);
+            tile_area += (double) image_list[i].cols * image_list[i].rows;
+        }
+        double canvas_area = (max_x - min_x) * (max_y - min_y);
+        if (!(canvas_area <= params.max_canvas_area_ratio * tile_area) ||
+            max_x - min_x > std::numeric_limits<int>::max() || max_y - min_y > std::numeric_limits<int>::max()) {
+            std::cout << "SpmGridStitcher::stitch() [Error]: Canvas " << max_x - min_x << " x " << max_y - min_y
+                      << " exceeds " << params.max_canvas_area_ratio << " times the summed tile area." << std::endl;
+            return false;
+        }
+        const int canvas_cols = (int) (max_x - min_x);
+        const int canvas_rows = (int) (max_y - min_y);
+
+        std::vector<cv::Point> position_list(tile_count);
+        std::vector<double> level_list(tile_count);
+        for (int i = 0; i < tile_count; ++i) {
+            position_list[i] = {(int) (x_list[i] - min_x), (int) (y_list[i] - min_y)};
+            level_list[i] = params.level_tiles ? solution.at<double>(i, 2) : 0;
+        }
+
+        compose(image_list, position_list, level_list, params, canvas_rows, canvas_cols, canvas);
+
+        if (placement_list) *placement_list = std::move(position_list);
+        return true;
+    }
+
+private:
+    // 预测位置相互重叠的图块对，offset 为图块 j 左上角在图块 i 中的坐标，level 为重叠区域中 j 与 i 的高度差，
+    // search_range 为实际可达的搜索范围（像素）
+    struct Pair {
+        int i = 0;
+        int j = 0;
+        bool valid = false;
+        int search_range = 0;
+        cv::Point2d offset;
+        double level = 0;
+        double weight = 0;
+    };
+
+    /**
+     * @brief 以归一化互相关配准图块对，image_b 的预测位置为 image_a 中的 predicted_offset
+     */
+    static bool registerPair(const cv::Mat &image_a, const cv::Mat &image_b, cv::Point predicted_offset,
+                             const Params &params, Pair &pair) {
+        cv::Rect rect_a(0, 0, image_a.cols, image_a.rows);
+        cv::Rect overlap = rect_a & cv::Rect(predicted_offset, image_b.size());
+        if (overlap.width < params.min_overlap || overlap.height < params.min_overlap) return false;
+
+        // 模板取自 image_b 的预测重叠区域，只在靠近 image_a 边界的一侧缩进，使偏移在搜索范围内时模板仍完全落在 image_a 中；
+        // 内侧由 image_a 的其余部分提供搜索空间，无需缩进
+        int shrink_left, shrink_right, shrink_top, shrink_bottom;
+        int range_x = borderShrink(overlap.x, overlap.width, image_a.cols, params, shrink_left, shrink_right);
+        int range_y = borderShrink(overlap.y, overlap.height, image_a.rows, params, shrink_top, shrink_bottom);
+        pair.search_range = std::min(range_x, range_y);
+
+        cv::Rect templ_a(overlap.x + shrink_left, overlap.y + shrink_top,
+                         overlap.width - shrink_left - shrink_right, overlap.height - shrink_top - shrink_bottom);
+        cv::Rect templ_b = templ_a - predicted_offset;
+
+        cv::Rect search_a = cv::Rect(templ_a.x - params.search_radius, templ_a.y - params.search_radius,
+                                     templ_a.width + 2 * params.search_radius,
+                                     templ_a.height + 2 * params.search_radius) & rect_a;
+        if (search_a.width < templ_a.width || search_a.height < templ_a.height) return false;
+
+        cv::Mat templ, search, result;
+        image_b(templ_b).convertTo(templ, CV_32F);
+        image_a(search_a).convertTo(search, CV_32F);
+
+        // 平坦的模板没有可配准的特征
+        cv::Scalar templ_mean, templ_stddev;
+        cv::meanStdDev(templ, templ_mean, templ_stddev);
+        if (!(templ_stddev[0] > 1e-12 * (std::abs(templ_mean[0]) + 1))) return false;
+
+        cv::matchTemplate(search, templ, result, cv::TM_CCOEFF_NORMED);
+
+        double max_value;
+        cv::Point max_loc;
+        cv::minMaxLoc(result, nullptr, &max_value, nullptr, &max_loc);
+        if (!std::isfinite(max_value) || max_value < params.min_correlation) return false;
+
+        // 峰值位于搜索范围的边界上时，真实偏移可能超出搜索范围
+        if ((result.cols >= 3 && (max_loc.x == 0 || max_loc.x == result.cols - 1)) ||
+            (result.rows >= 3 && (max_loc.y == 0 || max_loc.y == result.rows - 1))) {
+            return false;
+        }
+
+        // 抛物线插值得到亚像素峰值位置
+        cv::Point2d peak(max_loc);
+        if (result.cols >= 3) {
+            peak.x += parabolicPeak(result.at<float>(max_loc.y, max_loc.x - 1), result.at<float>(max_loc),
+                                    result.at<float>(max_loc.y, max_loc.x + 1));
+        }
+        if (result.rows >= 3) {
+            peak.y += parabolicPeak(result.at<float>(max_loc.y - 1, max_loc.x), result.at<float>(max_loc),
+                                    result.at<float>(max_loc.y + 1, max_loc.x));
+        }
+
+        // templ_b 的左上角对应 image_a 中的 search_a.tl() + peak
+        pair.offset = cv::Point2d(search_a.tl() - templ_b.tl()) + peak;
+        pair.weight = max_value;
+
+        cv::Rect matched_a(search_a.tl() + max_loc, templ_a.size());
+        pair.level = cv::mean(image_b(templ_b))[0] - cv::mean(image_a(matched_a))[0];
+
+        return true;
+    }
+
+    /**
+     * @brief 以有效的配准结果为边，统计图块的连通分量数（并查集）
+     */
+    /**
+     * @brief 计算重叠区域 [begin, begin + length) 两侧的缩进量，使模板向两侧移动 search_radius 后仍落在图块 [0, size) 中
+     *
+     * 每侧只缩进 search_radius 超出该侧到图块边界距离的部分，贴着边界的一侧缩进 min(search_radius, length - min_overlap)；
+     * 两侧的缩进量之和超过 length - min_overlap 时减小搜索范围。
+     *
+     * @return The search range reachable on both sides, at most search_radius.
+     */
+    static int borderShrink(int begin, int length, int size, const Params &params, int &shrink_begin,
+                            int &shrink_end) {
+        const int margin_begin = std::max(begin, 0), margin_end = std::max(size - begin - length, 0);
+        const int spare = std::max(length - params.min_overlap, 0);
+
+        int range = std::max(params.search_radius, 0);
+        while (range > 0 && std::max(range - margin_begin, 0) + std::max(range - margin_end, 0) > spare) --range;
+        shrink_begin = std::max(range - margin_begin, 0);
+        shrink_end = std::max(range - margin_end, 0);
+        return range;
+    }
+
+    static int countComponents(const std::vector<Pair> &pair_list, int tile_count) {
+        std::vector<int> parent(tile_count);
+        std::iota(parent.begin(), parent.end(), 0);
+        auto find_root = [&](int i) {
+            while (parent[i] != i) i = parent[i] = parent[parent[i]];
+            return i;
+        };
+
+        int component_count = tile_count;
+        for (const Pair &pair : pair_list) {
+            if (!pair.valid) continue;
+
+            int root_i = find_root(pair.i), root_j = find_root(pair.j);
+            if (root_i != root_j) {
+                parent[root_i] = root_j;
+                --component_count;
+            }
+        }
+
+        return component_count;
+    }
+
+    /**
+     * @brief 减去各坐标小数部分的圆周平均值后取整
+     */
+    static void roundToCommonGrid(std::vector<double> &coordinate_list) {
+        const double two_pi = 6.283185307179586;
+        double sin_sum = 0, cos_sum = 0;
+        for (double coordinate : coordinate_list) {
+            double fraction = coordinate - std::floor(coordinate);
+            sin_sum += std::sin(two_pi * fraction);
+            cos_sum += std::cos(two_pi * fraction);
+        }
+        double shift = std::atan2(sin_sum, cos_sum) / two_pi;
+
+        for (double &coordinate : coordinate_list) coordinate = std::round(coordinate - shift);
+    }
+
+    static double parabolicPeak(double left, double center, double right) {
+        double denominator = left - 2 * center + right;
+        if (denominator >= 0) return 0;
+        return std::clamp(0.5 * (left - right) / denominator, -0.5, 0.5);
+    }
+
+    /**
+     * @brief 加权最小二乘求解各图块的位置（x, y）与高度偏移（z）
+     *
+     * 每个有效的配准结果给出 p_j - p_i = offset 与 z_j - z_i = level（权重为相关系数），
+     * 每个图块另有 p_i = predicted、z_i = 0 的弱约束（prior_weight），使方程组总是正定。
+     * 求解后残差最大且超过 max_residual 的配准结果被剔除并重新求解。
+     *
+     * @param solution tile_count x 3 (x, y, z), CV_64F
+     */
+    static bool solvePlacement(std::vector<Pair> &pair_list, const std::vector<cv::Point> &predicted_px_list,
+                               const Params &params, cv::Mat &solution) {
+        const int tile_count = (int) predicted_px_list.size();
+        const double prior_weight = std::max(params.prior_weight, 1e-6);
+
+        while (true) {
+            cv::Mat normal = cv::Mat::zeros(tile_count, tile_count, CV_64F);
+            cv::Mat rhs = cv::Mat::zeros(tile_count, 3, CV_64F);
+            for (int i = 0; i < tile_count; ++i) {
+                normal.at<double>(i, i) = prior_weight;
+                rhs.at<double>(i, 0) = prior_weight * predicted_px_list[i].x;
+                rhs.at<double>(i, 1) = prior_weight * predicted_px_list[i].y;
+            }
+            for (const Pair &pair : pair_list) {
+                if (!pair.valid) continue;
+
+                const double w = pair.weight;
+                normal.at<double>(pair.i, pair.i) += w;
+                normal.at<double>(pair.j, pair.j) += w;
+                normal.at<double>(pair.i, pair.j) -= w;
+                normal.at<double>(pair.j, pair.i) -= w;
+
+                const double target[3] = {pair.offset.x, pair.offset.y, pair.level};
+                for (int k = 0; k < 3; ++k) {
+                    rhs.at<double>(pair.i, k) -= w * target[k];
+                    rhs.at<double>(pair.j, k) += w * target[k];
+                }
+            }
+
+            if (!cv::solve(normal, rhs, solution, cv::DECOMP_CHOLESKY)) return false;
+
+            Pair *worst_pair = nullptr;
+            double worst_residual = params.max_residual;
+            for (Pair &pair : pair_list) {
+                if (!pair.valid) continue;
+
+                double dx = solution.at<double>(pair.j, 0) - solution.at<double>(pair.i, 0) - pair.offset.x;
+                double dy = solution.at<double>(pair.j, 1) - solution.at<double>(pair.i, 1) - pair.offset.y;
+                double residual = std::sqrt(dx * dx + dy * dy);
+                if (residual > worst_residual) {
+                    worst_residual = residual;
+                    worst_pair = &pair;
+                }
+            }
+            if (!worst_pair) return true;
+
+            worst_pair->valid = false;
+        }
+    }
+
+    /**
+     * @brief 按位置将各图块（减去高度偏移）羽化叠加到画布上，画布各行块并行处理
+     */
+    static void compose(const std::vector<cv::Mat> &image_list, const std::vector<cv::Point> &position_list,
+                        const std::vector<double> &level_list, const Params &params,
+                        int canvas_rows, int canvas_cols, SpmHeightMap<double> &canvas) {
+        canvas.assign(canvas_rows, canvas_cols, 0.0);
+        std::vector<float> weight_sum((size_t) canvas_rows * canvas_cols, 0.0f);
+
+        const size_t grain = 64;
+        const size_t strip_count = ((size_t) canvas_rows + grain - 1) / grain;
+        std::vector<double> strip_min_list(strip_count, std::numeric_limits<double>::max());
+
+        SpmParallel::forEachRange((size_t) canvas_rows, grain, params.max_workers, [&](size_t begin, size_t end) {
+            std::vector<float> weight_x, weight_y;
+            for (size_t t = 0; t < image_list.size(); ++t) {
+                const cv::Mat &image = image_list[t];
+                const cv::Point &position = position_list[t];
+                int first_row = std::max((int) begin, position.y);
+                int last_row = std::min((int) end, position.y + image.rows);
+                if (first_row >= last_row) continue;
+
+                featherRamp(image.cols, params.feather, weight_x);
+                featherRamp(image.rows, params.feather, weight_y);
+                for (int r = first_row; r < last_row; ++r) {
+                    int tile_row = r - position.y;
+                    double *canvas_row = canvas.rowPtr(r) + position.x;
+                    float *weight_row = weight_sum.data() + (size_t) r * canvas_cols + position.x;
+                    if (image.depth() == CV_32F) {
+                        accumulateRow(image.ptr<float>(tile_row), image.cols, level_list[t], weight_y[tile_row],
+                                      weight_x.data(), canvas_row, weight_row);
+                    } else {
+                        accumulateRow(image.ptr<double>(tile_row), image.cols, level_list[t], weight_y[tile_row],
+                                      weight_x.data(), canvas_row, weight_row);
+                    }
+                }
+            }
+
+            double strip_min = std::numeric_limits<double>::max();
+            for (size_t r = begin; r < end; ++r) {
+                double *canvas_row = canvas.rowPtr((int) r);
+                const float *weight_row = weight_sum.data() + r * canvas_cols;
+                for (int c = 0; c < canvas_cols; ++c) {
+                    if (weight_row[c] > 0) {
+                        canvas_row[c] /= weight_row[c];
+                        strip_min = std::min(strip_min, canvas_row[c]);
+                    }
+                }
+            }
+            strip_min_list[begin / grain] = strip_min;
+        });
+
+        // 未被覆盖的像素设为最小值
+        double min_value = *std::min_element(strip_min_list.begin(), strip_min_list.end());
+        SpmParallel::forEachRange((size_t) canvas_rows, grain, params.max_workers, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r) {
+                double *canvas_row = canvas.rowPtr((int) r);
+                const float *weight_row = weight_sum.data() + r * canvas_cols;
+                for (int c = 0; c < canvas_cols; ++c) {
+                    if (weight_row[c] <= 0) canvas_row[c] = min_value;
+                }
+            }
+        });
+    }
+
+    template<typename T>
+    static void accumulateRow(const T *tile_row, int cols, double level, float row_weight, const float *col_weight,
+                              double *canvas_row, float *weight_row) {
+        for (int c = 0; c < cols; ++c) {
+            float w = std::min(row_weight, col_weight[c]);
+            canvas_row[c] += w * ((double) tile_row[c] - level);
+            weight_row[c] += w;
+        }
+    }
+
+    /**
+     * @brief 羽化权重: 距图块边缘 d 个像素（d >= 1）处为 min(d, feather) / feather，feather <= 0 时全部为 1
+     */
+    static void featherRamp(int size, int feather, std::vector<float> &ramp) {
+        ramp.resize(size);
+        for (int k = 0; k < size; ++k) {
+            int distance = std::min(k + 1, size - k);
+            ramp[k] = feather > 0 ? (float) std::min(distance, feather) / (float) feather : 1.0f;
+        }
+    }
+};
+
+
+#endif // SPM_GRID_STITCHER_HPP
@@ -0,0 +1,294 @@
+#ifndef SPM_HEADER_HPP
+#define SPM_HEADER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+#include "spm_file.hpp"
+#include "spm_number.hpp"
+
+
+/**
+ * @brief SPM 文件头段落索引
+ *
+ * 对一个段落文本（Head list 或 Image list）的 "\Key: value" 行只遍历一次，建立 key -> value 的索引。
+ * key 为去掉前导 '\' 的名称（如 "Data length"、"@2:Z scale"），value 为 ": " 之后的原始文本。
+ * 同名 key 仅保留第一次出现的值，与 std::regex_search 的匹配结果保持一致。
+ *
+ * 注意: 索引中保存的是指向段落文本的 string_view，段落文本的生命周期必须长于索引。
+ */
+class SpmHeaderIndex {
+public:
+    SpmHeaderIndex() = default;
+
+    explicit SpmHeaderIndex(std::string_view section_text) {
+        build(section_text);
+    }
+
+    ~SpmHeaderIndex() = default;
+
+public:
+    void build(std::string_view section_text) {
+        m_text = section_text;
+        m_index.clear();
+
+        size_t line_begin = 0;
+        while (line_begin < section_text.size()) {
+            size_t line_end = section_text.find('\n', line_begin);
+            if (line_end == std::string_view::npos) line_end = section_text.size();
+
+            addLine(section_text.substr(line_begin, line_end - line_begin));
+
+            line_begin = line_end + 1;
+        }
+    }
+
+    std::string_view text() const { return m_text; }
+
+    bool empty() const { return m_index.empty(); }
+
+    size_t size() const { return m_index.size(); }
+
+    bool contains(std::string_view key) const {
+        return m_index.find(key) != m_index.end();
+    }
+
+    bool getString(std::string_view key, std::string_view &value) const {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) return false;
+
+        value = it->second;
+        return true;
+    }
+
+    bool getInt(std::string_view key, int &value) const {
+        long long value_ll;
+        if (!getLongLong(key, value_ll)) return false;
+
+        value = (int) value_ll;
+        return true;
+    }
+
+    // 读取值开头的整数，如 "8192"、"5000 nm" -> 5000
+    bool getLongLong(std::string_view key, long long &value) const {
+        std::string_view value_str;
+        if (!getString(key, value_str)) return false;
+
+        return SpmNumberParser::parseInt(value_str, value) == SpmParseError::None;
+    }
+
+    // 读取值开头的浮点数
+    bool getDouble(std::string_view key, double &value) const {
+        std::string_view value_str;
+        if (!getString(key, value_str)) return false;
+
+        return SpmNumberParser::parseDouble(value_str, value) == SpmParseError::None;
+    }
+
+    /**
+     * @brief 读取 "number unit" 形式的长度并换算为 nm（四舍五入为整数）
+     *
+     * @param key The attribute key.
+     * @param value The value in nm.
+     * @return true if the key exists and the value is a valid length (see SpmNumberParser::parseLengthNM).
+     */
+    bool getLongLongToNM(std::string_view key, long long &value) const {
+        std::string_view value_str;
+        if (!getString(key, value_str)) return false;
+
+        return SpmNumberParser::parseLengthNM(value_str, value) == SpmParseError::None;
+    }
+
+    /**
+     * @brief 从 "@2:Image Data" 的值（如 S [Height] "Height Sensor"）中提取图像通道名称
+     *
+     * @param value The value of "@2:Image Data".
+     * @return image type, empty if not found
+     */
+    static std::string_view parseImageTypeValue(std::string_view value) {
+        size_t quote_begin = value.find('"');
+        if (quote_begin == std::string_view::npos) return {};
+
+        size_t quote_end = value.find('"', quote_begin + 1);
+        if (quote_end == std::string_view::npos) return {};
+
+        return value.substr(quote_begin + 1, quote_end - quote_begin - 1);
+    }
+
+private:
+    void addLine(std::string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        // 仅处理 "\Key: value" 行，跳过 "\*Section" 行
+        if (line.size() < 2 || line[0] != '\\' || line[1] == '*') return;
+        line.remove_prefix(1);
+
+        std::string_view key, value;
+        size_t sep_pos = line.find(": ");
+        if (sep_pos != std::string_view::npos) {
+            key = line.substr(0, sep_pos);
+            value = line.substr(sep_pos + 2);
+        } else if (line.back() == ':') {  // 空值
+            key = line.substr(0, line.size() - 1);
+        } else {
+            return;
+        }
+
+        m_index.emplace(key, value);  // 已存在时不覆盖
+    }
+
+private:
+    std::string_view m_text;
+    std::unordered_map<std::string_view, std::string_view> m_index;
+};
+
+
+/**
+ * @brief SPM 文件头字节级扫描器
+ *
+ * 直接在文件头字节数据上按 '\n' 切分行（兼容 "\r\n"），以 "\*Ciao image list" 和 "\*File list end" 为边界
+ * 划分 Head 段落与各 Image 段落。扫描结果均为指向文件头数据的 string_view，不进行宽字符转换与字符串拷贝。
+ *
+ * 注意: 文件头数据的生命周期必须长于扫描结果。
+ */
+class SpmHeaderScanner {
+public:
+    struct Section {
+        std::string_view image_type;  // Head 段落为空
+        std::string_view text;        // 段落文本，从段落起始行（Head 为文件第一行）到下一个段落边界之前
+    };
+
+    SpmHeaderScanner() = default;
+
+    ~SpmHeaderScanner() = default;
+
+public:
+    /**
+     * @brief 扫描文件头，header 可以包含文件头之后的数据（如整个内存映射文件），扫描到 "\*File list end" 为止
+     *
+     * @param header The header bytes.
+     * @return true if the head section and at least one image section are found
+     */
+    bool scan(std::string_view header) {
+        m_head = Section();
+        m_image_list.clear();
+        m_header = {};
+
+        size_t section_begin = 0;
+        bool head_done = false;
+        std::string_view image_type;
+
+        size_t line_begin = 0;
+        while (line_begin < header.size()) {
+            size_t line_end = header.find('\n', line_begin);
+            size_t next_line_begin = line_end == std::string_view::npos ? header.size() : line_end + 1;
+            std::string_view line = trimLine(header.substr(line_begin, next_line_begin - line_begin));
+
+            if (line.size() >= 2 && line[0] == '\\' && line[1] == '*') {
+                bool file_list_end = line == file_list_end_str;
+                if (file_list_end || line == ciao_image_list_str) {
+                    Section section{image_type, header.substr(section_begin, line_begin - section_begin)};
+                    if (!head_done) {
+                        m_head = section;
+                        head_done = true;
+                    } else {
+                        m_image_list.emplace_back(section);
+                    }
+
+                    section_begin = line_begin;
+                    image_type = {};
+
+                    if (file_list_end) {
+                        m_header = header.substr(0, next_line_begin);
+                        return !m_image_list.empty();
+                    }
+                }
+            } else if (head_done && image_type.empty() &&
+                       line.substr(0, image_data_prefix_str.size()) == image_data_prefix_str) {
+                // 扫描行时直接记录图像通道名称
+                image_type = SpmHeaderIndex::parseImageTypeValue(line.substr(image_data_prefix_str.size()));
+            }
+
+            line_begin = next_line_begin;
+        }
+
+        return false;  // 未找到 "\*File list end"
+    }
+
+    const Section &head() const { return m_head; }
+
+    const std::vector<Section> &imageList() const { return m_image_list; }
+
+    // 整个文件头，包含 "\*File list end" 行
+    std::string_view header() const { return m_header; }
+
+    /**
+     * @brief 从文件开头分块读取，直到读到 "\*File list end" 行为止，不读取像素数据
+     *
+     * @param file The opened file.
+     * @param header_buffer The header bytes read.
+     * @return true if "\*File list end" is found
+     */
+    static bool readHeaderBytes(const SpmFile &file, std::string &header_buffer) {
+        const size_t chunk_size = 64 * 1024;
+
+        header_buffer.clear();
+        size_t search_begin = 0;
+        while (true) {
+            size_t old_size = header_buffer.size();
+            header_buffer.resize(old_size + chunk_size);
+            size_t read_size = file.readAt(old_size, &header_buffer[old_size], chunk_size);
+            header_buffer.resize(old_size + read_size);
+
+            // 标记可能跨越两次读取的边界
+            size_t end_pos = header_buffer.find(file_list_end_str, search_begin);
+            if (end_pos != std::string::npos) {
+                size_t line_end = header_buffer.find('\n', end_pos);
+                if (line_end != std::string::npos) {
+                    header_buffer.resize(line_end + 1);
+                    return true;
+                }
+            } else if (header_buffer.size() >= file_list_end_str.size()) {
+                search_begin = header_buffer.size() - file_list_end_str.size();
+            }
+
+            if (read_size < chunk_size) return end_pos != std::string::npos;
+        }
+    }
+
+    /**
+     * @brief 逐行遍历文本，fn(line, line_with_eol): line 不含行尾的 "\r\n"，line_with_eol 含行尾
+     */
+    template<typename Fn>
+    static void forEachLine(std::string_view text, Fn &&fn) {
+        size_t line_begin = 0;
+        while (line_begin < text.size()) {
+            size_t line_end = text.find('\n', line_begin);
+            size_t next_line_begin = line_end == std::string_view::npos ? text.size() : line_end + 1;
+            std::string_view line_with_eol = text.substr(line_begin, next_line_begin - line_begin);
+            fn(trimLine(line_with_eol), line_with_eol);
+            line_begin = next_line_begin;
+        }
+    }
+
+    static std::string_view trimLine(std::string_view line) {
+        if (!line.empty() && line.back() == '\n') line.remove_suffix(1);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        return line;
+    }
+
+public:
+    static constexpr std::string_view file_list_end_str = "\\*File list end";
+    static constexpr std::string_view ciao_image_list_str = "\\*Ciao image list";
+    static constexpr std::string_view image_data_prefix_str = "\\@2:Image Data: ";
+
+private:
+    Section m_head;
+    std::vector<Section> m_image_list;
+    std::string_view m_header;
+};
+
+
+#endif //SPM_HEADER_HPP
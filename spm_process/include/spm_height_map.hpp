@@ -0,0 +1,266 @@
+#ifndef SPM_HEIGHT_MAP_HPP
+#define SPM_HEIGHT_MAP_HPP
+
+#include <vector>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+
+/**
+ * @brief 一行数据的非持有视图，接口与 std::vector 的只读部分一致（begin / end / size / operator[]）
+ */
+template<typename T>
+class SpmRowSpan {
+public:
+    SpmRowSpan() = default;
+
+    SpmRowSpan(T *data, size_t size)
+            : m_data(data), m_size(size) {}
+
+public:
+    T *begin() const { return m_data; }
+
+    T *end() const { return m_data + m_size; }
+
+    T *data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+
+    bool empty() const { return m_size == 0; }
+
+    T &operator[](size_t i) const { return m_data[i]; }
+
+private:
+    T *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+
+/**
+ * @brief 按行遍历二维数据的迭代器，解引用得到 SpmRowSpan，使 "for (auto &row : data)" 可直接使用
+ */
+template<typename T>
+class SpmRowIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = SpmRowSpan<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = SpmRowSpan<T> *;
+    using reference = SpmRowSpan<T> &;
+
+    SpmRowIterator(T *row, size_t cols, size_t stride)
+            : m_span(row, cols), m_stride(stride) {}
+
+public:
+    reference operator*() { return m_span; }
+
+    pointer operator->() { return &m_span; }
+
+    SpmRowIterator &operator++() {
+        m_span = SpmRowSpan<T>(m_span.data() + m_stride, m_span.size());
+        return *this;
+    }
+
+    bool operator==(const SpmRowIterator &other) const { return m_span.data() == other.m_span.data(); }
+
+    bool operator!=(const SpmRowIterator &other) const { return m_span.data() != other.m_span.data(); }
+
+private:
+    SpmRowSpan<T> m_span;
+    size_t m_stride;
+};
+
+
+/**
+ * @brief 行主序二维高度数据的非持有视图
+ *
+ * 行与行之间相隔 stride 个元素（stride >= cols），可表示整幅图像或其中的若干行 / 子区域。
+ */
+template<typename T>
+class SpmHeightMapView {
+public:
+    using value_type = std::remove_const_t<T>;
+
+    SpmHeightMapView() = default;
+
+    SpmHeightMapView(T *data, int rows, int cols, size_t stride)
+            : m_data(data), m_rows(rows), m_cols(cols), m_stride(stride) {}
+
+    SpmHeightMapView(T *data, int rows, int cols)
+            : SpmHeightMapView(data, rows, cols, (size_t) cols) {}
+
+    // SpmHeightMapView<T> -> SpmHeightMapView<const T>
+    template<typename U, typename = std::enable_if_t<std::is_same_v<const U, T> && !std::is_same_v<U, T>>>
+    SpmHeightMapView(const SpmHeightMapView<U> &other)
+            : m_data(other.data()), m_rows(other.rows()), m_cols(other.cols()), m_stride(other.stride()) {}
+
+public:
+    T *data() const { return m_data; }
+
+    int rows() const { return m_rows; }
+
+    int cols() const { return m_cols; }
+
+    size_t stride() const { return m_stride; }
+
+    bool empty() const { return m_data == nullptr || m_rows <= 0 || m_cols <= 0; }
+
+    bool isContinuous() const { return m_stride == (size_t) m_cols || m_rows <= 1; }
+
+    size_t size() const { return (size_t) m_rows; }
+
+    T *rowPtr(int r) const { return m_data + r * m_stride; }
+
+    SpmRowSpan<T> row(int r) const { return {rowPtr(r), (size_t) m_cols}; }
+
+    SpmRowSpan<T> operator[](size_t r) const { return row((int) r); }
+
+    T &at(int r, int c) const { return m_data[r * m_stride + c]; }
+
+    SpmRowIterator<T> begin() const { return {m_data, (size_t) m_cols, m_stride}; }
+
+    SpmRowIterator<T> end() const { return {m_data + m_rows * m_stride, (size_t) m_cols, m_stride}; }
+
+    /**
+     * @brief 截取 [first_row, first_row + num_rows) 行
+     */
+    SpmHeightMapView rowRange(int first_row, int num_rows) const {
+        return {rowPtr(first_row), num_rows, m_cols, m_stride};
+    }
+
+    /**
+     * @brief 截取子区域
+     */
+    SpmHeightMapView subView(int first_row, int first_col, int num_rows, int num_cols) const {
+        return {rowPtr(first_row) + first_col, num_rows, num_cols, m_stride};
+    }
+
+private:
+    T *m_data = nullptr;
+    int m_rows = 0;
+    int m_cols = 0;
+    size_t m_stride = 0;
+};
+
+
+/**
+ * @brief 行主序二维高度数据容器
+ *
+ * 所有数据保存在一块连续内存中（行间隔 stride 个元素），取代 std::vector<std::vector<T>>:
+ * 只需一次堆分配，按行访问具有良好的局部性，并可零拷贝地包装为 cv::Mat（见 SpmAlgorithm）。
+ * 行访问接口（size / operator[] / begin / end）与 std::vector<std::vector<T>> 兼容。
+ */
+template<typename T>
+class SpmHeightMap {
+public:
+    using value_type = T;
+
+    SpmHeightMap() = default;
+
+    SpmHeightMap(int rows, int cols, T value = T())
+            : m_rows(rows), m_cols(cols), m_stride((size_t) cols),
+              m_buffer((size_t) rows * cols, value) {}
+
+    ~SpmHeightMap() = default;
+
+    SpmHeightMap(const SpmHeightMap &) = default;
+
+    SpmHeightMap &operator=(const SpmHeightMap &) = default;
+
+    // 移动后源对象为空（0 x 0），缓冲区所有权整体转移，不拷贝数据
+    SpmHeightMap(SpmHeightMap &&other) noexcept
+            : m_rows(std::exchange(other.m_rows, 0)), m_cols(std::exchange(other.m_cols, 0)),
+              m_stride(std::exchange(other.m_stride, 0)), m_buffer(std::move(other.m_buffer)) {}
+
+    SpmHeightMap &operator=(SpmHeightMap &&other) noexcept {
+        if (this != &other) {
+            m_rows = std::exchange(other.m_rows, 0);
+            m_cols = std::exchange(other.m_cols, 0);
+            m_stride = std::exchange(other.m_stride, 0);
+            m_buffer = std::move(other.m_buffer);
+            other.m_buffer.clear();
+        }
+        return *this;
+    }
+
+public:
+    void assign(int rows, int cols, T value = T()) {
+        m_rows = rows;
+        m_cols = cols;
+        m_stride = (size_t) cols;
+        m_buffer.assign((size_t) rows * cols, value);
+    }
+
+    /**
+     * @brief 分配 rows x cols 的空间，不保证初始化数据（用于随后会被完全覆盖写入的场景）
+     */
+    void create(int rows, int cols) {
+        m_rows = rows;
+        m_cols = cols;
+        m_stride = (size_t) cols;
+        m_buffer.resize((size_t) rows * cols);
+    }
+
+    void clear() {
+        m_rows = 0;
+        m_cols = 0;
+        m_stride = 0;
+        m_buffer.clear();
+        m_buffer.shrink_to_fit();
+    }
+
+    T *data() { return m_buffer.data(); }
+
+    const T *data() const { return m_buffer.data(); }
+
+    int rows() const { return m_rows; }
+
+    int cols() const { return m_cols; }
+
+    size_t stride() const { return m_stride; }
+
+    bool empty() const { return m_rows <= 0 || m_cols <= 0; }
+
+    size_t size() const { return (size_t) m_rows; }
+
+    size_t byteSize() const { return m_buffer.size() * sizeof(T); }
+
+    T *rowPtr(int r) { return m_buffer.data() + r * m_stride; }
+
+    const T *rowPtr(int r) const { return m_buffer.data() + r * m_stride; }
+
+    SpmRowSpan<T> row(int r) { return {rowPtr(r), (size_t) m_cols}; }
+
+    SpmRowSpan<const T> row(int r) const { return {rowPtr(r), (size_t) m_cols}; }
+
+    SpmRowSpan<T> operator[](size_t r) { return row((int) r); }
+
+    SpmRowSpan<const T> operator[](size_t r) const { return row((int) r); }
+
+    T &at(int r, int c) { return m_buffer[r * m_stride + c]; }
+
+    const T &at(int r, int c) const { return m_buffer[r * m_stride + c]; }
+
+    SpmRowIterator<T> begin() { return view().begin(); }
+
+    SpmRowIterator<T> end() { return view().end(); }
+
+    SpmRowIterator<const T> begin() const { return view().begin(); }
+
+    SpmRowIterator<const T> end() const { return view().end(); }
+
+    SpmHeightMapView<T> view() { return {m_buffer.data(), m_rows, m_cols, m_stride}; }
+
+    SpmHeightMapView<const T> view() const { return {m_buffer.data(), m_rows, m_cols, m_stride}; }
+
+private:
+    int m_rows = 0;
+    int m_cols = 0;
+    size_t m_stride = 0;
+    std::vector<T> m_buffer;
+};
+
+
+#endif //SPM_HEIGHT_MAP_HPP
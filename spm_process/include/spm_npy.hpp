@@ -0,0 +1,302 @@
+#ifndef SPM_NPY_HPP
+#define SPM_NPY_HPP
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "spm_file.hpp"
+#include "spm_height_map.hpp"
+
+
+/**
+ * @brief NumPy .npy 文件格式（v1.0）的工具函数
+ *
+ * 文件结构: "\x93NUMPY" + 版本号 (1, 0) + uint16 小端的头长度 + Python 字典形式的头 + 行主序数据。
+ * 头部以空格填充并以 '\n' 结尾，使数据起始于 64 字节边界，可直接用 numpy.load(mmap_mode='r') 内存映射。
+ */
+class SpmNpy {
+public:
+    static constexpr size_t header_alignment = 64;
+
+    /**
+     * @brief 元素类型对应的 descr 字符串，如 "<f8"、"<f4"、"<i4"
+     */
+    template<typename T>
+    static std::string descr() {
+        static_assert(std::is_arithmetic_v<T>, "SpmNpy::descr(): T must be an arithmetic type");
+
+        char kind = std::is_floating_point_v<T> ? 'f' : (std::is_signed_v<T> ? 'i' : 'u');
+        char byte_order = sizeof(T) == 1 ? '|' : (isLittleEndian() ? '<' : '>');
+        return std::string{byte_order, kind} + std::to_string(sizeof(T));
+    }
+
+    /**
+     * @brief 生成完整的文件头（含 magic 与长度字段），长度按 header_alignment 对齐
+     *
+     * @param min_size minimum total header size, used to keep the data offset fixed when rewriting the header
+     */
+    static std::string makeHeader(const std::string &descr, const std::vector<long long> &shape, size_t min_size = 0) {
+        std::string shape_str = "(";
+        for (size_t i = 0; i < shape.size(); ++i) {
+            if (i > 0) shape_str += ", ";
+            shape_str += std::to_string(shape[i]);
+        }
+        if (shape.size() == 1) shape_str += ",";
+        shape_str += ")";
+
+        std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shape_str + ", }";
+
+        size_t total_size = preamble_size + dict.size() + 1;
+        if (total_size < min_size) total_size = min_size;
+        total_size = (total_size + header_alignment - 1) / header_alignment * header_alignment;
+
+        size_t dict_size = total_size - preamble_size;
+        dict.append(dict_size - dict.size() - 1, ' ');
+        dict += '\n';
+
+        std::string header(magic, sizeof(magic) - 1);
+        header += (char) 1;  // major version
+        header += (char) 0;  // minor version
+        header += (char) (dict_size & 0xFF);
+        header += (char) ((dict_size >> 8) & 0xFF);
+        header += dict;
+        return header;
+    }
+
+    /**
+     * @brief 将二维数据写入 .npy 文件，shape 为 (rows, cols)
+     *
+     * 连续数据一次写出，不经过中间缓冲。
+     *
+     * @param npy_path UTF-8 path
+     * @return false if the data is empty or the file cannot be written
+     */
+    template<typename T>
+    static bool write(const std::string &npy_path, SpmHeightMapView<const T> data) {
+        if (data.empty()) {
+            std::cout << "SpmNpy::write() [Error]: Empty data: " << npy_path << std::endl;
+            return false;
+        }
+
+        std::ofstream npy_file(SpmFile::fromUtf8(npy_path), std::ios::binary | std::ios::trunc);
+        if (!npy_file.is_open()) {
+            std::cout << "SpmNpy::write() [Error]: Failed to create file: " << npy_path << std::endl;
+            return false;
+        }
+
+        std::string header = makeHeader(descr<T>(), {data.rows(), data.cols()});
+        npy_file.write(header.data(), (std::streamsize) header.size());
+        writeData(npy_file, data);
+
+        if (!npy_file.good()) {
+            std::cout << "SpmNpy::write() [Error]: Failed to write file: " << npy_path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    static bool write(const std::string &npy_path, const SpmHeightMap<T> &data) {
+        return write<T>(npy_path, SpmHeightMapView<const T>(data.data(), data.rows(), data.cols(), data.stride()));
+    }
+
+    template<typename T>
+    static bool write(const std::string &npy_path, const std::vector<T> &data, int rows, int cols) {
+        if ((size_t) rows * cols != data.size()) {
+            std::cout << "SpmNpy::write() [Error]: Data size does not match the shape: " << npy_path << std::endl;
+            return false;
+        }
+        return write<T>(npy_path, SpmHeightMapView<const T>(data.data(), rows, cols));
+    }
+
+    template<typename T>
+    static void writeData(std::ofstream &npy_file, SpmHeightMapView<const T> data) {
+        if (data.isContinuous()) {
+            npy_file.write(reinterpret_cast<const char *>(data.data()),
+                           (std::streamsize) ((size_t) data.rows() * data.cols() * sizeof(T)));
+            return;
+        }
+        for (int r = 0; r < data.rows(); ++r) {
+            npy_file.write(reinterpret_cast<const char *>(data.rowPtr(r)), (std::streamsize) (data.cols() * sizeof(T)));
+        }
+    }
+
+private:
+    static constexpr char magic[] = "\x93NUMPY";
+    static constexpr size_t preamble_size = 10;  // magic(6) + version(2) + header length(2)
+
+    static bool isLittleEndian() {
+        const uint16_t value = 1;
+        unsigned char first_byte;
+        std::memcpy(&first_byte, &value, 1);
+        return first_byte == 1;
+    }
+
+private:
+    SpmNpy() = default;
+
+    ~SpmNpy() = default;
+};
+
+
+/**
+ * @brief 将多个相同尺寸的图块逐个写入一个 shape 为 (count, rows, cols) 的 .npy 文件
+ *
+ * 图块可以整块写入（append），也可以按行条带分多次写入（appendRows，如配合 SpmImage::decodeStrips()），
+ * 内存中无需同时保存所有图块。实际写入的完整图块数少于 count 时，close() 会改写文件头中的图块数
+ * （头部长度不变）并截掉不完整的图块，文件仍然有效。
+ */
+template<typename T>
+class SpmNpyStackWriter {
+public:
+    SpmNpyStackWriter() = default;
+
+    ~SpmNpyStackWriter() { close(); }
+
+    SpmNpyStackWriter(const SpmNpyStackWriter &) = delete;
+
+    SpmNpyStackWriter &operator=(const SpmNpyStackWriter &) = delete;
+
+public:
+    /**
+     * @param npy_path UTF-8 path
+     * @param count expected number of tiles
+     * @param rows rows of each tile
+     * @param cols cols of each tile
+     */
+    bool open(const std::string &npy_path, size_t count, int rows, int cols) {
+        close();
+
+        if (rows <= 0 || cols <= 0) {
+            std::cout << "SpmNpyStackWriter::open() [Error]: Invalid tile size: " << rows << " x " << cols << std::endl;
+            return false;
+        }
+
+        m_npy_file.open(SpmFile::fromUtf8(npy_path), std::ios::binary | std::ios::trunc);
+        if (!m_npy_file.is_open()) {
+            std::cout << "SpmNpyStackWriter::open() [Error]: Failed to create file: " << npy_path << std::endl;
+            return false;
+        }
+
+        m_npy_path = npy_path;
+        m_count = count;
+        m_rows = rows;
+        m_cols = cols;
+        m_written_rows = 0;
+
+        std::string header = SpmNpy::makeHeader(SpmNpy::descr<T>(), {(long long) m_count, m_rows, m_cols});
+        m_header_size = header.size();
+        m_npy_file.write(header.data(), (std::streamsize) header.size());
+        return m_npy_file.good();
+    }
+
+    /**
+     * @brief 追加一个完整的图块
+     *
+     * @return false if a previous tile is incomplete, the tile size does not match, the stack is full or the write fails
+     */
+    bool append(SpmHeightMapView<const T> tile) {
+        if (m_npy_file.is_open() && m_written_rows % m_rows != 0) {
+            std::cout << "SpmNpyStackWriter::append() [Error]: Previous tile is incomplete: " << m_npy_path << std::endl;
+            return false;
+        }
+        if (tile.rows() != m_rows) {
+            std::cout << "SpmNpyStackWriter::append() [Error]: Tile size " << tile.rows() << " x " << tile.cols()
+                      << " does not match " << m_rows << " x " << m_cols << ": " << m_npy_path << std::endl;
+            return false;
+        }
+        return appendRows(tile);
+    }
+
+    bool append(const SpmHeightMap<T> &tile) {
+        return append(SpmHeightMapView<const T>(tile.data(), tile.rows(), tile.cols(), tile.stride()));
+    }
+
+    /**
+     * @brief 追加若干行，图块按行依次填满
+     *
+     * @return false if the row width does not match, the stack is full or the write fails
+     */
+    bool appendRows(SpmHeightMapView<const T> rows) {
+        if (!m_npy_file.is_open()) {
+            std::cout << "SpmNpyStackWriter::appendRows() [Error]: File is not open" << std::endl;
+            return false;
+        }
+        if (rows.cols() != m_cols) {
+            std::cout << "SpmNpyStackWriter::appendRows() [Error]: Row width " << rows.cols() << " does not match "
+                      << m_cols << ": " << m_npy_path << std::endl;
+            return false;
+        }
+        if (m_written_rows + rows.rows() > (unsigned long long) m_count * m_rows) {
+            std::cout << "SpmNpyStackWriter::appendRows() [Error]: Stack is full: " << m_npy_path << std::endl;
+            return false;
+        }
+        if (rows.empty()) return true;
+
+        SpmNpy::writeData(m_npy_file, rows);
+        if (!m_npy_file.good()) {
+            std::cout << "SpmNpyStackWriter::appendRows() [Error]: Failed to write file: " << m_npy_path << std::endl;
+            return false;
+        }
+
+        m_written_rows += rows.rows();
+        return true;
+    }
+
+    /**
+     * @brief 结束写入，完整图块数不足 count 时改写文件头并截掉不完整的图块
+     */
+    bool close() {
+        if (!m_npy_file.is_open()) return true;
+
+        size_t written = getWrittenCount();
+        bool good = true;
+        if (written != m_count) {
+            std::string header = SpmNpy::makeHeader(SpmNpy::descr<T>(), {(long long) written, m_rows, m_cols},
+                                                    m_header_size);
+            m_npy_file.seekp(0);
+            m_npy_file.write(header.data(), (std::streamsize) header.size());
+            good = m_npy_file.good();
+        }
+        m_npy_file.close();
+
+        if (m_written_rows % m_rows != 0) {
+            std::error_code ec;
+            std::filesystem::resize_file(SpmFile::fromUtf8(m_npy_path),
+                                         m_header_size + (unsigned long long) written * m_rows * m_cols * sizeof(T), ec);
+            if (ec) good = false;
+        }
+
+        if (!good) {
+            std::cout << "SpmNpyStackWriter::close() [Error]: Failed to finish file: " << m_npy_path << std::endl;
+        }
+        return good;
+    }
+
+    bool isOpen() const { return m_npy_file.is_open(); }
+
+    int getRows() const { return m_rows; }
+
+    int getCols() const { return m_cols; }
+
+    // 已完整写入的图块数
+    size_t getWrittenCount() const { return m_rows > 0 ? (size_t) (m_written_rows / m_rows) : 0; }
+
+private:
+    std::ofstream m_npy_file;
+    std::string m_npy_path;
+    size_t m_count = 0;
+    int m_rows = 0;
+    int m_cols = 0;
+    unsigned long long m_written_rows = 0;
+    size_t m_header_size = 0;
+};
+
+
+#endif // SPM_NPY_HPP
@@ -0,0 +1,228 @@
+#ifndef SPM_NUMBER_HPP
+#define SPM_NUMBER_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <string_view>
+#include <system_error>
+
+
+// 数值解析的错误码
+enum class SpmParseError {
+    None,
+    Empty,          // 没有数值
+    InvalidNumber,  // 不是合法的数值
+    OutOfRange,     // 超出类型范围
+    UnknownUnit     // 无法识别的单位
+};
+
+
+/**
+ * @brief 基于 std::from_chars 的数值解析
+ *
+ * 直接在 string_view 上解析，不分配内存、不抛出异常，错误通过 SpmParseError 返回。
+ * 支持文件头中常见的 "number unit" 形式，并将长度统一换算为 nm、电压统一换算为 V。
+ */
+class SpmNumberParser {
+private:
+    SpmNumberParser() = default;
+
+    ~SpmNumberParser() = default;
+
+public:
+    /**
+     * @brief 解析整数，跳过前导空格，允许前导 '+'
+     *
+     * @param text The text to parse.
+     * @param value The parsed value, unchanged on error.
+     * @param rest The text after the number, may be nullptr.
+     * @return error code
+     */
+    static SpmParseError parseInt(std::string_view text, long long &value, std::string_view *rest = nullptr) {
+        text = skipSpaces(text);
+        if (text.empty()) return SpmParseError::Empty;
+
+        std::string_view number = skipPlus(text);
+        long long result;
+        auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), result);
+        if (ec == std::errc::result_out_of_range) return SpmParseError::OutOfRange;
+        if (ec != std::errc()) return SpmParseError::InvalidNumber;
+
+        value = result;
+        if (rest) *rest = number.substr((size_t) (end - number.data()));
+        return SpmParseError::None;
+    }
+
+    /**
+     * @brief 解析浮点数（十进制或科学计数法），跳过前导空格，允许前导 '+'
+     *
+     * @param text The text to parse.
+     * @param value The parsed value, unchanged on error.
+     * @param rest The text after the number, may be nullptr.
+     * @return error code
+     */
+    static SpmParseError parseDouble(std::string_view text, double &value, std::string_view *rest = nullptr) {
+        text = skipSpaces(text);
+        if (text.empty()) return SpmParseError::Empty;
+
+        std::string_view number = skipPlus(text);
+        double result;
+        auto [end, ec] = std::from_chars(number.data(), number.data() + number.size(), result,
+                                         std::chars_format::general);
+        if (ec == std::errc::result_out_of_range) return SpmParseError::OutOfRange;
+        if (ec != std::errc()) return SpmParseError::InvalidNumber;
+
+        value = result;
+        if (rest) *rest = number.substr((size_t) (end - number.data()));
+        return SpmParseError::None;
+    }
+
+    /**
+     * @brief 解析 "number unit" 形式的长度并换算为 nm，单位见 lengthUnitScaleNM()
+     *
+     * @param text The text to parse, e.g. "-19783.4 um".
+     * @param value_nm The length in nm, unchanged on error.
+     * @param rest The text after the unit, may be nullptr.
+     * @return error code
+     */
+    static SpmParseError parseLengthNM(std::string_view text, double &value_nm, std::string_view *rest = nullptr) {
+        double number;
+        std::string_view unit_text;
+        SpmParseError error = parseDouble(text, number, &unit_text);
+        if (error != SpmParseError::None) return error;
+
+        double scale;
+        error = lengthUnitScaleNM(leadingToken(unit_text, &unit_text), scale);
+        if (error != SpmParseError::None) return error;
+
+        value_nm = number * scale;
+        if (rest) *rest = unit_text;
+        return SpmParseError::None;
+    }
+
+    /**
+     * @brief 解析长度并换算为整数 nm（四舍五入）
+     */
+    static SpmParseError parseLengthNM(std::string_view text, long long &value_nm, std::string_view *rest = nullptr) {
+        double length_nm;
+        SpmParseError error = parseLengthNM(text, length_nm, rest);
+        if (error != SpmParseError::None) return error;
+
+        return roundToLongLong(length_nm, value_nm);
+    }
+
+    /**
+     * @brief 解析 "number unit" 形式的电压并换算为 V，单位见 voltageUnitScaleV()
+     *
+     * @param text The text to parse, e.g. "4.000000 mV".
+     * @param value_v The voltage in V, unchanged on error.
+     * @param rest The text after the unit, may be nullptr.
+     * @return error code
+     */
+    static SpmParseError parseVoltageV(std::string_view text, double &value_v, std::string_view *rest = nullptr) {
+        double number;
+        std::string_view unit_text;
+        SpmParseError error = parseDouble(text, number, &unit_text);
+        if (error != SpmParseError::None) return error;
+
+        double scale;
+        error = voltageUnitScaleV(leadingToken(unit_text, &unit_text), scale);
+        if (error != SpmParseError::None) return error;
+
+        value_v = number * scale;
+        if (rest) *rest = unit_text;
+        return SpmParseError::None;
+    }
+
+    /**
+     * @brief 长度单位换算为 nm 的系数: pm, nm, um, ~m (Bruker 文件头中 µm 的写法), µm, mm, m
+     */
+    static SpmParseError lengthUnitScaleNM(std::string_view unit, double &scale) {
+        if (unit == "nm") {
+            scale = 1.0;
+        } else if (unit == "um" || unit == "~m" || unit == "\xC2\xB5m") {
+            scale = 1e3;
+        } else if (unit == "mm") {
+            scale = 1e6;
+        } else if (unit == "pm") {
+            scale = 1e-3;
+        } else if (unit == "m") {
+            scale = 1e9;
+        } else {
+            return SpmParseError::UnknownUnit;
+        }
+
+        return SpmParseError::None;
+    }
+
+    /**
+     * @brief 电压单位换算为 V 的系数: V, mV, uV, ~V (Bruker 文件头中 µV 的写法), µV
+     */
+    static SpmParseError voltageUnitScaleV(std::string_view unit, double &scale) {
+        if (unit == "V") {
+            scale = 1.0;
+        } else if (unit == "mV") {
+            scale = 1e-3;
+        } else if (unit == "uV" || unit == "~V" || unit == "\xC2\xB5V") {
+            scale = 1e-6;
+        } else {
+            return SpmParseError::UnknownUnit;
+        }
+
+        return SpmParseError::None;
+    }
+
+    static SpmParseError roundToLongLong(double number, long long &value) {
+        if (!std::isfinite(number) || std::fabs(number) >= 9.2e18) return SpmParseError::OutOfRange;
+
+        value = std::llround(number);
+        return SpmParseError::None;
+    }
+
+    static const char *errorString(SpmParseError error) {
+        switch (error) {
+            case SpmParseError::None:
+                return "None";
+            case SpmParseError::Empty:
+                return "Empty";
+            case SpmParseError::InvalidNumber:
+                return "Invalid number";
+            case SpmParseError::OutOfRange:
+                return "Out of range";
+            case SpmParseError::UnknownUnit:
+                return "Unknown unit";
+            default:
+                return "Unknown error";
+        }
+    }
+
+    static std::string_view skipSpaces(std::string_view text) {
+        size_t begin = text.find_first_not_of(" \t");
+        return begin == std::string_view::npos ? std::string_view() : text.substr(begin);
+    }
+
+    /**
+     * @brief 取第一个空白之前的部分
+     *
+     * @param text The text.
+     * @param rest The text after the token, may be nullptr.
+     * @return token
+     */
+    static std::string_view leadingToken(std::string_view text, std::string_view *rest = nullptr) {
+        text = skipSpaces(text);
+        size_t end = std::min(text.find(' '), text.size());
+        if (rest) *rest = text.substr(end);
+        return text.substr(0, end);
+    }
+
+private:
+    static std::string_view skipPlus(std::string_view text) {
+        // from_chars 不接受前导 '+'
+        if (text.size() > 1 && text[0] == '+' && text[1] != '-') text.remove_prefix(1);
+        return text;
+    }
+};
+
+
+#endif //SPM_NUMBER_HPP
@@ -0,0 +1,104 @@
+#ifndef SPM_PARALLEL_HPP
+#define SPM_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class SpmParallel {
+private:
+    SpmParallel() = default;
+
+    ~SpmParallel() = default;
+
+public:
+    /**
+     * @brief 默认工作线程数: 硬件并发线程数，至少为 1
+     */
+    static int defaultWorkerCount() {
+        unsigned int hardware_threads = std::thread::hardware_concurrency();
+        return hardware_threads == 0 ? 1 : (int) hardware_threads;
+    }
+
+    /**
+     * @brief 在有界线程池上并行执行 fn(0) ... fn(count - 1)
+     *
+     * 各任务按索引动态分配给工作线程，调用线程也参与执行。所有任务完成后返回；
+     * 若有任务抛出异常，则在全部线程结束后重新抛出第一个异常。
+     *
+     * @param count The number of tasks.
+     * @param max_workers The maximum number of worker threads, <= 0 for defaultWorkerCount().
+     * @param fn The task function, called as fn(size_t index).
+     * @return None
+     */
+    template<typename Fn>
+    static void forEachIndex(size_t count, int max_workers, Fn &&fn) {
+        if (count == 0) return;
+
+        if (max_workers <= 0) max_workers = defaultWorkerCount();
+        size_t worker_count = std::min((size_t) max_workers, count);
+
+        if (worker_count == 1) {
+            for (size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        std::atomic<size_t> next_index{0};
+        std::exception_ptr first_exception;
+        std::mutex exception_mutex;
+
+        auto worker = [&]() {
+            for (size_t i = next_index++; i < count; i = next_index++) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    if (!first_exception) first_exception = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(worker_count - 1);
+        for (size_t t = 0; t + 1 < worker_count; ++t) {
+            threads.emplace_back(worker);
+        }
+        worker();
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        if (first_exception) std::rethrow_exception(first_exception);
+    }
+
+    /**
+     * @brief 将 [0, count) 按 grain 个索引一块划分，在有界线程池上并行执行 fn(begin, end)
+     *
+     * 适用于单个索引开销很小的场景（如逐行处理），块数为 1 时直接在调用线程中执行，不创建线程。
+     *
+     * @param count The number of indices.
+     * @param grain The number of indices per chunk, 0 is treated as 1.
+     * @param max_workers The maximum number of worker threads, <= 0 for defaultWorkerCount().
+     * @param fn The chunk function, called as fn(size_t begin, size_t end).
+     * @return None
+     */
+    template<typename Fn>
+    static void forEachRange(size_t count, size_t grain, int max_workers, Fn &&fn) {
+        if (count == 0) return;
+        if (grain == 0) grain = 1;
+
+        size_t chunk_count = (count + grain - 1) / grain;
+        forEachIndex(chunk_count, max_workers, [&](size_t chunk) {
+            size_t begin = chunk * grain;
+            fn(begin, std::min(begin + grain, count));
+        });
+    }
+};
+
+
+#endif //SPM_PARALLEL_HPP
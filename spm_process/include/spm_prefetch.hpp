@@ -0,0 +1,162 @@
+#ifndef SPM_PREFETCH_HPP
+#define SPM_PREFETCH_HPP
+
+#include <iostream>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spm_file.hpp"
+
+
+/**
+ * @brief 异步预读取 SPM 文件
+ *
+ * 后台线程按列表顺序将文件的全部字节读取到内存中，最多领先使用方 depth 个文件，且已读取但尚未取走的数据
+ * 不超过 max_bytes（单个文件超过上限时，仅在没有其他待取数据时读取）。使用方通过 take(i) 取得第 i 个文件的数据，
+ * 在处理（解码、拉平）当前文件的同时，后续文件的 I/O 已在后台进行，用于隐藏网络共享等慢速存储的读取延迟。
+ *
+ * 使用方应大致按索引递增的顺序调用 take()；每个索引只能取一次。
+ */
+class SpmPrefetchReader {
+public:
+    static constexpr int default_depth = 4;
+    static constexpr unsigned long long default_max_bytes = 512ULL * 1024 * 1024;  // 512 MB
+
+    /**
+     * @param spm_path_list The UTF-8 file paths, an empty path is skipped (take() returns nullptr).
+     * @param depth The maximum number of files read ahead, at least 1.
+     * @param max_bytes The maximum bytes held by files read but not yet taken.
+     */
+    explicit SpmPrefetchReader(std::vector<std::string> spm_path_list, int depth = default_depth,
+                               unsigned long long max_bytes = default_max_bytes)
+            : m_spm_path_list(std::move(spm_path_list)),
+              m_depth(depth < 1 ? 1 : (size_t) depth),
+              m_max_bytes(max_bytes),
+              m_slot_list(m_spm_path_list.size()) {
+        m_thread = std::thread(&SpmPrefetchReader::run, this);
+    }
+
+    ~SpmPrefetchReader() {
+        stop();
+    }
+
+    SpmPrefetchReader(const SpmPrefetchReader &) = delete;
+
+    SpmPrefetchReader &operator=(const SpmPrefetchReader &) = delete;
+
+public:
+    size_t size() const { return m_spm_path_list.size(); }
+
+    /**
+     * @brief 取得第 index 个文件的全部字节，数据尚未读取完成时阻塞等待
+     *
+     * @param index The file index.
+     * @return the file bytes, nullptr if the file is skipped, failed to read, or already taken
+     */
+    std::shared_ptr<const std::vector<char>> take(size_t index) {
+        if (index >= m_slot_list.size()) return nullptr;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Slot &slot = m_slot_list[index];
+        m_cv.wait(lock, [&] { return slot.state != SlotState::Pending || m_stop; });
+
+        if (slot.state != SlotState::Ready) return nullptr;
+
+        std::shared_ptr<const std::vector<char>> file_data = std::move(slot.file_data);
+        slot.state = SlotState::Taken;
+        m_ready_count -= 1;
+        m_ready_bytes -= file_data->size();
+        m_cv.notify_all();
+
+        return file_data;
+    }
+
+    /**
+     * @brief 停止预读取，未读取的文件均视为读取失败
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+private:
+    enum class SlotState {
+        Pending,
+        Ready,
+        Failed,
+        Taken
+    };
+
+    struct Slot {
+        SlotState state = SlotState::Pending;
+        std::shared_ptr<std::vector<char>> file_data;
+    };
+
+    void run() {
+        for (size_t i = 0; i < m_spm_path_list.size(); ++i) {
+            auto file_data = std::make_shared<std::vector<char>>();
+            bool status = !m_spm_path_list[i].empty() && readFile(i, *file_data);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) break;
+
+            if (status) {
+                m_slot_list[i].state = SlotState::Ready;
+                m_slot_list[i].file_data = std::move(file_data);
+                m_ready_count += 1;
+                m_ready_bytes += m_slot_list[i].file_data->size();
+            } else {
+                m_slot_list[i].state = SlotState::Failed;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    bool readFile(size_t index, std::vector<char> &file_data) {
+        SpmFile spm_file;
+        if (!spm_file.open(SpmFile::fromUtf8(m_spm_path_list[index]))) {
+            std::cout << "SpmPrefetchReader::readFile() [Error]: Failed to open SPM file: " << m_spm_path_list[index]
+                      << std::endl;
+            return false;
+        }
+
+        // 等待已读取的数据被取走，直到满足预读取深度与内存上限
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&] {
+                return m_stop || m_ready_count == 0 ||
+                       (m_ready_count < m_depth && m_ready_bytes + spm_file.size() <= m_max_bytes);
+            });
+            if (m_stop) return false;
+        }
+
+        file_data.resize((size_t) spm_file.size());
+        return spm_file.readAt(0, file_data.data(), file_data.size()) == file_data.size();
+    }
+
+private:
+    std::vector<std::string> m_spm_path_list;
+    size_t m_depth;
+    unsigned long long m_max_bytes;
+
+    std::vector<Slot> m_slot_list;
+    size_t m_ready_count = 0;
+    unsigned long long m_ready_bytes = 0;
+    bool m_stop = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+};
+
+
+#endif //SPM_PREFETCH_HPP
@@ -3,47 +3,27 @@
 
 #include <iostream>
 #include <fstream>
-#include <windows.h>
 #include <regex>
 #include <cmath>
+#include <cstdio>
+#include <algorithm>
 #include <utility>
 #include <string>
 #include <vector>
+#include <memory>
 #include <unordered_map>
 
+#include "spm_header.hpp"
+#include "spm_schema.hpp"
+#include "spm_file.hpp"
+#include "spm_height_map.hpp"
+#include "spm_npy.hpp"
+#include "spm_decode.hpp"
+#include "spm_tile_cache.hpp"
+
 
 class StringOperations {
 protected:
-    /**
-     * @brief string 转 wstring
-     *
-     * @param str src string
-     * @param CodePage The encoding format of the file calling this function. CP_ACP for gbk, CP_UTF8 for utf-8.
-     * @return dst string
-     */
-    static std::wstring string2wstring(const std::string &str, _In_ UINT CodePage = CP_ACP) {
-        int len = MultiByteToWideChar(CodePage, 0, str.c_str(), -1, nullptr, 0);
-        std::wstring wstr(len, L'\0');
-        MultiByteToWideChar(CodePage, 0, str.c_str(), -1, const_cast<wchar_t *>(wstr.data()), len);
-        wstr.resize(wcslen(wstr.c_str()));
-        return wstr;
-    }
-
-    /**
-     * @brief wstring 转 string
-     *
-     * @param wstr src wstring
-     * @param CodePage The encoding format of the file calling this function. CP_ACP for gbk, CP_UTF8 for utf-8.
-     * @return dst string
-     */
-    static std::string wstring2string(const std::wstring &wstr, _In_ UINT CodePage = CP_ACP) {
-        int len = WideCharToMultiByte(CodePage, 0, wstr.c_str(), -1, nullptr, 0, nullptr, nullptr);
-        std::string str(len, '\0');
-        WideCharToMultiByte(CodePage, 0, wstr.c_str(), -1, const_cast<char *>(str.data()), len, nullptr, nullptr);
-        str.resize(strlen(str.c_str()));
-        return str;
-    }
-
     static std::string doubleToDecimalString(double value, int decimal_num) {
         double temp = value;
         int digits = 0;
@@ -82,21 +62,21 @@ protected:
     static int getIntFromTextByRegex(const std::string &regex_string, std::string &spm_file_text) {
         std::regex pattern(regex_string);
         std::smatch matches;
+        long long value = 0;
         if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 2) {
-            return std::stoi(matches[1].str());
-        } else {
-            return 0;
+            SpmNumberParser::parseInt(matchView(spm_file_text, matches, 1), value);
         }
+        return (int) value;
     }
 
     static double getDoubleFromTextByRegex(const std::string &regex_string, std::string &spm_file_text) {
         std::regex pattern(regex_string);
         std::smatch matches;
+        double value = 0;
         if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 2) {
-            return std::stod(matches[1].str());
-        } else {
-            return 0;
+            SpmNumberParser::parseDouble(matchView(spm_file_text, matches, 1), value);
         }
+        return value;
     }
 
     static std::string getStringFromTextByRegex(const std::string &regex_string, std::string &spm_file_text) {
@@ -110,37 +90,28 @@ protected:
     }
 
     static int getIntFromTextByRegexToNM(const std::string &regex_string, std::string &spm_file_text) {
-        std::regex pattern(regex_string);
-        std::smatch matches;
-        if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 3) {
-            if (matches[2].str() == "nm") {
-                return std::stoi(matches[1].str());
-            } else if (matches[2].str() == "um") {
-                return (int) (std::stod(matches[1].str()) * 1000);
-            } else {  // error
-                return 0;
-            }
-        } else {
-            return 0;
-        }
+        return (int) getLongLongFromTextByRegexToNM(regex_string, spm_file_text);
     }
 
+    // 捕获组 1 为数值、捕获组 2 为单位，单位换算见 SpmNumberParser::parseLengthNM()，无法解析时返回 0
     static long long getLongLongFromTextByRegexToNM(const std::string &regex_string, std::string &spm_file_text) {
         std::regex pattern(regex_string);
         std::smatch matches;
+        long long value = 0;
         if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 3) {
-            if (matches[2].str() == "nm") {
-                return std::stoll(matches[1].str());
-            } else if (matches[2].str() == "um") {
-                return (long long) (std::stod(matches[1].str()) * 1000);
-            } else if (matches[2].str() == "mm") {
-                return (long long) (std::stoll(matches[1].str()) * 1000 * 1000);
-            } else {  // error
+            double number, scale;
+            if (SpmNumberParser::parseDouble(matchView(spm_file_text, matches, 1), number) != SpmParseError::None ||
+                SpmNumberParser::lengthUnitScaleNM(matchView(spm_file_text, matches, 2), scale) != SpmParseError::None) {
                 return 0;
             }
-        } else {
-            return 0;
+            SpmNumberParser::roundToLongLong(number * scale, value);
         }
+        return value;
+    }
+
+    // 捕获组在原文中的视图，不拷贝
+    static std::string_view matchView(const std::string &spm_file_text, const std::smatch &matches, size_t i) {
+        return std::string_view(spm_file_text).substr((size_t) matches.position(i), (size_t) matches.length(i));
     }
 
     static bool replaceIntFromTextByRegex(const std::string &regex_string, std::string &spm_file_text, int new_value) {
@@ -173,64 +144,174 @@ protected:
             return false;
         }
     }
+
+    /**
+     * @brief 按行中原有的长度单位改写 "\Key: number... unit" 形式的数值
+     *
+     * Head list 中的 Scan Size 形如 "5000 nm"，Image list 中形如 "5 5 ~m"（X、Y 两个数值），
+     * 所有数值均改写为新的长度，单位及其后的文本保持不变。
+     *
+     * @param line The header line.
+     * @param new_value_nm The new length in nm.
+     * @return false if the value is not a length, the line is unchanged then
+     */
+    static bool replaceLengthNMFromText(std::string &line, long long new_value_nm) {
+        size_t value_pos = line.find(": ");
+        if (value_pos == std::string::npos) return false;
+        value_pos += 2;
+
+        // 连续的数值之后为单位
+        std::string_view rest = std::string_view(line).substr(value_pos);
+        std::string_view token = SpmNumberParser::leadingToken(rest, &rest);
+        size_t number_count = 0;
+        double number;
+        std::string_view number_rest;
+        while (SpmNumberParser::parseDouble(token, number, &number_rest) == SpmParseError::None &&
+               number_rest.empty()) {
+            ++number_count;
+            token = SpmNumberParser::leadingToken(rest, &rest);
+        }
+
+        double scale;
+        if (number_count == 0 || SpmNumberParser::lengthUnitScaleNM(token, scale) != SpmParseError::None) {
+            return false;
+        }
+
+        // 保留足以精确表示整数 nm 的小数位，并去掉末尾的 0
+        int decimals = std::max(0, (int) std::lround(std::log10(scale)));
+        char number_buffer[64];
+        int number_size = std::snprintf(number_buffer, sizeof(number_buffer), "%.*f", decimals,
+                                        (double) new_value_nm / scale);
+        std::string number_str(number_buffer, (size_t) std::max(number_size, 0));
+        if (decimals > 0) {
+            number_str.erase(number_str.find_last_not_of('0') + 1);
+            if (number_str.back() == '.') number_str.pop_back();
+        }
+
+        std::string new_line = line.substr(0, value_pos);
+        for (size_t i = 0; i < number_count; ++i) {
+            new_line += number_str;
+            new_line += ' ';
+        }
+        new_line += token;
+        new_line += rest;
+        line = std::move(new_line);
+        return true;
+    }
 };
 
 
-class SpmImage : public SpmRegexParse {
+class SpmImage {
 public:
+    // Real data 的存储精度
+    enum class DataPrecision {
+        Float64,  // double
+        Float32   // float，内存占用减半，适用于 16 位等精度较低的仪器信号
+    };
+
+    // Raw data 的保留方式
+    enum class RawDataRetention {
+        Keep,    // 同时保留 raw data 与 real data
+        Drop,    // 只生成 real data，不保留 raw data，适用于拼接等不再读取 raw data 的场景
+        RawOnly  // 只保留 raw data，real data 在第一次 getRealData() / getRealDataF32() 时由 raw data 换算
+    };
+
+    // 缓存键中使用的存储精度标识
+    static std::string getDataPrecisionTag(DataPrecision data_precision) {
+        return data_precision == DataPrecision::Float32 ? "f32" : "f64";
+    }
+
+    // decodeStrips() 默认的条带行数
+    static constexpr int default_strip_rows = 64;
+
     explicit SpmImage(int scan_size)
             : m_scan_size(scan_size) {}
 
     ~SpmImage() = default;
 
+    SpmImage(const SpmImage &) = default;
+
+    SpmImage &operator=(const SpmImage &) = default;
+
+    SpmImage(SpmImage &&) = default;
+
+    SpmImage &operator=(SpmImage &&) = default;
+
 public:
-    void parseImageAttributes(std::string &spm_file_text) {
-        // Can be modified: 可添加需要的属性
-        m_data_length = getIntFromTextByRegex(data_length_regex, spm_file_text);
-        m_data_offset = getIntFromTextByRegex(data_offset_regex, spm_file_text);
-        m_bytes_per_pixel = getIntFromTextByRegex(bytes_per_pixel_regex, spm_file_text);
-        m_frame_direction = getStringFromTextByRegex(frame_direction_regex, spm_file_text);
-        m_capture_start_line = getIntFromTextByRegex(capture_start_line_regex, spm_file_text);
-        m_color_table_index = getIntFromTextByRegex(color_table_index_regex, spm_file_text);
-        m_relative_frame_time = getDoubleFromTextByRegex(relative_frame_time_regex, spm_file_text);
-        m_samps_per_line = getIntFromTextByRegex(samps_per_line_regex, spm_file_text);
-        m_number_of_lines = getIntFromTextByRegex(number_of_lines_regex, spm_file_text);
+    /**
+     * @brief 解析图像属性
+     *
+     * @return false if a required attribute (SpmAttributeSchema::required_image_attribute_list) is missing
+     */
+    bool parseImageAttributes(const SpmHeaderIndex &image_index) {
+        // Can be modified: 可添加需要的属性（同时在 SpmAttributeSchema 中添加）
+        using Schema = SpmAttributeSchema;
+        bool status = true;
+        for (const auto &spec : Schema::required_image_attribute_list) {
+            long long value;
+            if (!Schema::read(image_index, spec, value)) {
+                std::cout << "SpmImage::parseImageAttributes() [Error]: Missing required attribute: " << spec.key
+                          << std::endl;
+                status = false;
+            }
+        }
+
+        m_data_length = Schema::get<unsigned int>(image_index, Schema::data_length);
+        m_data_offset = Schema::get<unsigned int>(image_index, Schema::data_offset);
+        m_bytes_per_pixel = Schema::get<unsigned int>(image_index, Schema::bytes_per_pixel);
+        m_frame_direction = Schema::get<std::string>(image_index, Schema::frame_direction);
+        m_capture_start_line = Schema::get<unsigned int>(image_index, Schema::capture_start_line);
+        m_color_table_index = Schema::get<unsigned int>(image_index, Schema::color_table_index);
+        m_relative_frame_time = Schema::get<double>(image_index, Schema::relative_frame_time);
+        m_samps_per_line = Schema::get<unsigned int>(image_index, Schema::samps_per_line);
+        m_number_of_lines = Schema::get<unsigned int>(image_index, Schema::number_of_lines);
+
+        return status;
     }
 
-    void setZScale(std::string &spm_file_text, std::string &head_text) {
-        std::pair<double, std::string> z_scale_info = getZScaleInfoFromTextByRegex(spm_file_text);
+    bool parseImageAttributes(std::string &spm_file_text) {
+        return parseImageAttributes(SpmHeaderIndex(spm_file_text));
+    }
+
+    void setZScale(const SpmHeaderIndex &image_index, const SpmHeaderIndex &head_index) {
+        std::pair<double, std::string> z_scale_info = getZScaleInfoFromIndex(image_index);
 
         m_z_scale = z_scale_info.first;
 
-        std::string z_scale_sens_regex = R"(\@)" + z_scale_info.second + R"(: V (\d+(\.\d+)?) .*)";
-        m_z_scale_sens = getDoubleFromTextByRegex(z_scale_sens_regex, head_text);
+        // Head list 中的灵敏度，形如 "@Sens. ZsensSens: V 5120.500 nm/V"
+        std::string_view z_scale_sens_value;
+        m_z_scale_sens = 0;
+        if (!z_scale_info.second.empty() && head_index.getString("@" + z_scale_info.second, z_scale_sens_value) &&
+            z_scale_sens_value.substr(0, 2) == "V ") {
+            SpmNumberParser::parseDouble(z_scale_sens_value.substr(2), m_z_scale_sens);
+        }
+    }
+
+    void setZScale(std::string &spm_file_text, std::string &head_text) {
+        setZScale(SpmHeaderIndex(spm_file_text), SpmHeaderIndex(head_text));
     }
 
     bool setImageData(std::vector<char> &byte_data) {
-        // set raw data
+        return setImageData(byte_data.data(), byte_data.size());
+    }
+
+    /**
+     * @brief 由图像字节数据计算 raw data 与 real data（按 raw data 的保留方式）
+     *
+     * @param byte_data The image byte data, e.g. a view into the memory mapped SPM file.
+     * @param byte_size The size of the byte data.
+     * @return true if successful
+     */
+    bool setImageData(const char *byte_data, size_t byte_size) {
+        if (!isImageSourceValid(byte_size)) return false;
+
         if (m_bytes_per_pixel == 2) {
-            std::vector<short> raw_data_16;
-            raw_data_16.assign(reinterpret_cast<const short *>(byte_data.data()),
-                               reinterpret_cast<const short *>(byte_data.data() + byte_data.size()));
-            m_raw_data.assign(raw_data_16.begin(), raw_data_16.end());
-        } else if (m_bytes_per_pixel == 4) {
-            m_raw_data.assign(reinterpret_cast<const int *>(byte_data.data()),
-                              reinterpret_cast<const int *>(byte_data.data() + byte_data.size()));
-        } else {
-            return false;
+            decodeImageData<2>(byte_data, byte_size);
+        } else {  // m_bytes_per_pixel == 4
+            decodeImageData<4>(byte_data, byte_size);
         }
 
-        // calc real data
-        for (int r = (int) (m_number_of_lines - 1); r >= 0; r--) {
-            std::vector<double> line_data;
-            line_data.reserve(m_samps_per_line);
-            for (int c = 0; c < m_samps_per_line; c++) {
-                line_data.emplace_back(
-                        m_raw_data[r * m_samps_per_line + c] * m_z_scale_sens * m_z_scale /
-                        std::pow(2, 8 * m_bytes_per_pixel));
-            }
-            m_real_data.emplace_back(line_data);
-        }
+        m_decoded = true;
 
         return true;
     }
@@ -239,9 +320,242 @@ public:
 
     unsigned int getDataOffset() const { return m_data_offset; }
 
-    std::vector<int> &getRawData() { return m_raw_data; }
+    /**
+     * @brief 设置图像字节数据的来源，像素数据延迟到第一次 getRealData() / getRawData() 时解码
+     *
+     * @param source_owner The owner of the byte data (e.g. the mapped file), kept alive until decoded.
+     * @param byte_data The image byte data.
+     * @param byte_size The size of the byte data.
+     * @return None
+     */
+    void setImageSource(std::shared_ptr<const void> source_owner, const char *byte_data, size_t byte_size) {
+        m_source_owner = std::move(source_owner);
+        m_source_data = byte_data;
+        m_source_size = byte_size;
+        m_decoded = false;
+    }
+
+    /**
+     * @brief 检查图像属性与字节数据大小是否可以解码，不解码像素数据
+     */
+    bool isImageSourceValid(size_t byte_size) const {
+        if (m_bytes_per_pixel != 2 && m_bytes_per_pixel != 4) return false;
+        return byte_size >= (size_t) m_number_of_lines * m_samps_per_line * m_bytes_per_pixel;
+    }
+
+    bool isDecoded() const { return m_decoded; }
 
-    std::vector<std::vector<double>> &getRealData() { return m_real_data; }
+    /**
+     * @brief 解码图像数据（若尚未解码），解码后释放字节数据来源
+     *
+     * @return true if the image data is available
+     */
+    bool decodeImageData() {
+        if (m_decoded) return true;
+
+        // 优先从图块缓存中读取已解码的数据，RawOnly 需要 raw data，不使用缓存
+        bool use_tile_cache = m_tile_cache && m_raw_data_retention != RawDataRetention::RawOnly;
+        if (use_tile_cache && loadRealDataFromCache(*m_tile_cache, m_tile_key)) return true;
+
+        if (!m_source_data) return false;
+
+        bool status = setImageData(m_source_data, m_source_size);
+        if (!status) std::cout << "decodeImageData() [Error]: Failed to decode SPM image data." << std::endl;
+
+        releaseImageSource();
+
+        if (status && use_tile_cache) storeRealDataToCache(*m_tile_cache, m_tile_key);
+
+        return status;
+    }
+
+    /**
+     * @brief 设置图块缓存，解码时先查找缓存，未命中时解码并写入缓存
+     *
+     * Note: 缓存只保存 real data，命中缓存时不生成 raw data；RawOnly 方式下不使用该缓存
+     */
+    void setTileCache(std::shared_ptr<SpmTileCache> tile_cache, SpmTileKey tile_key) {
+        m_tile_cache = std::move(tile_cache);
+        m_tile_key = std::move(tile_key);
+    }
+
+    /**
+     * @brief 从图块缓存中读取 real data（按当前存储精度），成功后视为已解码
+     *
+     * @return true if the cache hits
+     */
+    bool loadRealDataFromCache(SpmTileCache &tile_cache, const SpmTileKey &tile_key) {
+        bool status;
+        if (m_data_precision == DataPrecision::Float32) {
+            status = tile_cache.load(tile_key, m_real_data_f32);
+        } else {
+            status = tile_cache.load(tile_key, m_real_data);
+        }
+        if (!status) return false;
+
+        // 只保留缓存中的一份 real data
+        if (m_data_precision == DataPrecision::Float32) {
+            m_real_data.clear();
+        } else {
+            m_real_data_f32.clear();
+        }
+
+        m_decoded = true;
+        releaseImageSource();
+
+        return true;
+    }
+
+    /**
+     * @brief 将 real data（按当前存储精度）写入图块缓存，RawOnly 方式下会先由 raw data 换算 real data
+     */
+    bool storeRealDataToCache(SpmTileCache &tile_cache, const SpmTileKey &tile_key) {
+        if (!m_decoded) return false;
+
+        if (m_data_precision == DataPrecision::Float32) {
+            return tile_cache.store(tile_key, getRealDataF32());
+        } else {
+            return tile_cache.store(tile_key, getRealData());
+        }
+    }
+
+    // Note: 首次调用时解码像素数据，非线程安全；Drop 方式或命中图块缓存时为空
+    std::vector<int> &getRawData() {
+        decodeImageData();
+        return m_raw_data;
+    }
+
+    /**
+     * @brief 设置 raw data 的保留方式，需在解码之前设置
+     */
+    void setRawDataRetention(RawDataRetention raw_data_retention) { m_raw_data_retention = raw_data_retention; }
+
+    RawDataRetention getRawDataRetention() const { return m_raw_data_retention; }
+
+    /**
+     * @brief 释放 raw data，如 RawOnly 方式下已换算出 real data 且不再需要 raw data 时
+     */
+    void releaseRawData() {
+        std::vector<int>().swap(m_raw_data);
+    }
+
+    /**
+     * @brief 释放全部图像数据（raw data、real data 与字节数据来源），只保留图像属性
+     *
+     * 用于图像数据已转存到其他位置（如 SpmTileStore）的场景，此后 getRealData() 等返回空数据。
+     */
+    void releaseImageData() {
+        releaseRawData();
+        m_real_data.clear();
+        m_real_data_f32.clear();
+        releaseImageSource();
+        m_decoded = true;  // 不再解码
+    }
+
+    /**
+     * @brief 设置 real data 的存储精度，需在解码之前设置
+     */
+    void setDataPrecision(DataPrecision data_precision) { m_data_precision = data_precision; }
+
+    DataPrecision getDataPrecision() const { return m_data_precision; }
+
+    /**
+     * @brief real data（double），返回的引用可修改
+     *
+     * 图像只保存一份 real data: Float32 精度下调用该函数会将 float 数据换算为 double 并释放 float 数据，
+     * 使通过该引用所做的修改（如拉平）对 getRealDataF32()、decodeStrips()、缓存等所有读取方式可见。
+     * 应优先使用与存储精度一致的函数。
+     */
+    SpmHeightMap<double> &getRealData() {
+        decodeImageData();
+        if (m_real_data.empty()) {
+            if (!m_real_data_f32.empty()) {
+                convertRealData(m_real_data_f32, m_real_data);
+            } else if (!m_raw_data.empty()) {
+                convertRawData(m_real_data);
+            }
+        }
+        m_real_data_f32.clear();
+        return m_real_data;
+    }
+
+    /**
+     * @brief real data（float），返回的引用可修改
+     *
+     * 同 getRealData()，Float64 精度下调用该函数会将 double 数据换算为 float（损失精度）并释放 double 数据。
+     */
+    SpmHeightMap<float> &getRealDataF32() {
+        decodeImageData();
+        if (m_real_data_f32.empty()) {
+            if (!m_real_data.empty()) {
+                convertRealData(m_real_data, m_real_data_f32);
+            } else if (!m_raw_data.empty()) {
+                convertRawData(m_real_data_f32);
+            }
+        }
+        m_real_data.clear();
+        return m_real_data_f32;
+    }
+
+    /**
+     * @brief 取走 real data（缓冲区所有权转移，不拷贝），随后释放全部图像数据，同 releaseImageData()
+     */
+    SpmHeightMap<double> takeRealData() {
+        SpmHeightMap<double> real_data = std::move(getRealData());
+        releaseImageData();
+        return real_data;
+    }
+
+    SpmHeightMap<float> takeRealDataF32() {
+        SpmHeightMap<float> real_data = std::move(getRealDataF32());
+        releaseImageData();
+        return real_data;
+    }
+
+    /**
+     * @brief 按行条带流式解码 real data，不保存整幅图像
+     *
+     * 每次将 strip_rows 行（最后一个条带可能更少）解码到同一个条带缓冲区中，并调用 fn(first_row, strip)，
+     * 行号与 getRealData() 一致（已翻转行顺序），条带按 first_row 递增的顺序给出。fn 可以修改条带数据，
+     * 不影响图像本身。峰值内存只有一个条带，不生成 raw data，也不改变解码状态与字节数据来源；
+     * 映射模式下字节数据直接来自映射内存，因此处理单个大文件时内存占用与图像尺寸无关。
+     * 已解码的图像直接从 real data（RawOnly 方式下尚未换算时为 raw data）中按条带换算。
+     *
+     * @param strip_rows The number of rows per strip.
+     * @param fn The strip callback, called as fn(int first_row, const SpmHeightMapView<T> &strip).
+     * @return false if neither the byte data source nor the decoded data is available
+     */
+    template<typename T = double, typename Fn>
+    bool decodeStrips(int strip_rows, Fn &&fn) {
+        const int rows = (int) m_number_of_lines;
+        const int cols = (int) m_samps_per_line;
+        if (strip_rows <= 0 || rows <= 0 || cols <= 0) return false;
+
+        if (m_decoded) {
+            if (!m_real_data_f32.empty() && (m_data_precision == DataPrecision::Float32 || m_real_data.empty())) {
+                return copyStrips<T>(m_real_data_f32, strip_rows, fn);
+            } else if (!m_real_data.empty()) {
+                return copyStrips<T>(m_real_data, strip_rows, fn);
+            } else if (m_raw_data.size() >= (size_t) rows * cols) {
+                // raw data 已加宽为 int，按 4 字节布局解码，换算系数仍取决于原始 bytes/pixel
+                decodeStripsImpl<4, T>(reinterpret_cast<const char *>(m_raw_data.data()), calcDecodeScale(),
+                                       strip_rows, fn);
+                return true;
+            } else {
+                return false;
+            }
+        }
+
+        if (!m_source_data || !isImageSourceValid(m_source_size)) return false;
+
+        if (m_bytes_per_pixel == 2) {
+            decodeStripsImpl<2, T>(m_source_data, calcDecodeScale<2>(), strip_rows, fn);
+        } else {  // m_bytes_per_pixel == 4
+            decodeStripsImpl<4, T>(m_source_data, calcDecodeScale<4>(), strip_rows, fn);
+        }
+
+        return true;
+    }
 
     int getRows() const { return (int) m_number_of_lines; }
 
@@ -254,22 +568,132 @@ public:
     double getZScaleSens() const { return m_z_scale_sens; }
 
 private:
-    static std::pair<double, std::string> getZScaleInfoFromTextByRegex(std::string &spm_file_text) {
-        std::string z_scale_regex = R"(\@2:Z scale: V \[(.*?)\] \(.*?\) (\d+\.\d+) (.*))";
-        std::regex pattern(z_scale_regex);
-        std::smatch matches;
-        if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 4) {
-            double value = std::stod(matches[2].str());
+    void releaseImageSource() {
+        m_source_owner.reset();
+        m_source_data = nullptr;
+        m_source_size = 0;
+    }
+
+    template<int BytesPerPixel>
+    void decodeImageData(const char *byte_data, size_t byte_size) {
+        // set raw data, uniformly converted to 4 bytes (int)
+        if (m_raw_data_retention != RawDataRetention::Drop) {
+            size_t count = byte_size / BytesPerPixel;
+            m_raw_data.resize(count);
+            SpmDecodeKernel::widenRawData<BytesPerPixel>(byte_data, count, m_raw_data.data());
+        }
 
-            std::string unit = matches[3].str();
-            if (unit == "mV") value /= 1000;  // convert mV to V uniformly
+        if (m_raw_data_retention == RawDataRetention::RawOnly) return;  // real data 在第一次访问时换算
 
-            return {value, matches[1].str()};
+        // calc real data, 行顺序与文件中相反
+        double scale = calcDecodeScale<BytesPerPixel>();
+        if (m_data_precision == DataPrecision::Float32) {
+            m_real_data_f32.create((int) m_number_of_lines, (int) m_samps_per_line);
+            SpmDecodeKernel::decodeFlipped<BytesPerPixel>(byte_data, m_real_data_f32.view(), scale);
         } else {
-            return {0, ""};
+            m_real_data.create((int) m_number_of_lines, (int) m_samps_per_line);
+            SpmDecodeKernel::decodeFlipped<BytesPerPixel>(byte_data, m_real_data.view(), scale);
         }
     }
 
+    // 由 raw data 换算 real data（行顺序与文件中相反）
+    template<typename T>
+    void convertRawData(SpmHeightMap<T> &real_data) const {
+        real_data.create((int) m_number_of_lines, (int) m_samps_per_line);
+        SpmDecodeKernel::decodeFlipped<4>(reinterpret_cast<const char *>(m_raw_data.data()), real_data.view(),
+                                          calcDecodeScale());
+    }
+
+    template<int BytesPerPixel>
+    double calcDecodeScale() const {
+        return m_z_scale_sens * m_z_scale / std::pow(2, 8 * BytesPerPixel);
+    }
+
+    double calcDecodeScale() const {
+        return m_bytes_per_pixel == 2 ? calcDecodeScale<2>() : calcDecodeScale<4>();
+    }
+
+    // byte_data 为 BytesPerPixel 布局的图像数据（文件中的行顺序）
+    template<int BytesPerPixel, typename T, typename Fn>
+    void decodeStripsImpl(const char *byte_data, double scale, int strip_rows, Fn &fn) const {
+        const int rows = (int) m_number_of_lines;
+        const int cols = (int) m_samps_per_line;
+        const size_t line_bytes = (size_t) cols * BytesPerPixel;
+
+        SpmHeightMap<T> strip_buffer;
+        strip_buffer.create(std::min(strip_rows, rows), cols);
+        for (int first_row = 0; first_row < rows; first_row += strip_rows) {
+            int num_rows = std::min(strip_rows, rows - first_row);
+            SpmHeightMapView<T> strip = strip_buffer.view().rowRange(0, num_rows);
+
+            // 输出的第 [first_row, first_row + num_rows) 行对应文件中的第 [rows - first_row - num_rows, rows - first_row) 行
+            const char *strip_bytes = byte_data + (size_t) (rows - first_row - num_rows) * line_bytes;
+            SpmDecodeKernel::decodeFlipped<BytesPerPixel>(strip_bytes, strip, scale);
+
+            fn(first_row, strip);
+        }
+    }
+
+    template<typename T, typename SrcT, typename Fn>
+    static bool copyStrips(const SpmHeightMap<SrcT> &real_data, int strip_rows, Fn &fn) {
+        if (real_data.empty()) return false;
+
+        SpmHeightMap<T> strip_buffer;
+        strip_buffer.create(std::min(strip_rows, real_data.rows()), real_data.cols());
+        for (int first_row = 0; first_row < real_data.rows(); first_row += strip_rows) {
+            int num_rows = std::min(strip_rows, real_data.rows() - first_row);
+            SpmHeightMapView<T> strip = strip_buffer.view().rowRange(0, num_rows);
+
+            for (int r = 0; r < num_rows; ++r) {
+                const SrcT *src_line = real_data.rowPtr(first_row + r);
+                T *dst_line = strip.rowPtr(r);
+                for (int c = 0; c < real_data.cols(); ++c) {
+                    dst_line[c] = (T) src_line[c];
+                }
+            }
+
+            fn(first_row, strip);
+        }
+
+        return true;
+    }
+
+    template<typename SrcT, typename DstT>
+    static void convertRealData(const SpmHeightMap<SrcT> &src, SpmHeightMap<DstT> &dst) {
+        dst.create(src.rows(), src.cols());
+        for (int r = 0; r < src.rows(); ++r) {
+            const SrcT *src_line = src.rowPtr(r);
+            DstT *dst_line = dst.rowPtr(r);
+            for (int c = 0; c < src.cols(); ++c) {
+                dst_line[c] = (DstT) src_line[c];
+            }
+        }
+    }
+
+    // value 形如: V [Sens. ZsensSens] (0.006713867 V/LSB) 2.000000 V
+    static std::pair<double, std::string> getZScaleInfoFromIndex(const SpmHeaderIndex &image_index) {
+        std::string_view value;
+        if (image_index.getString(SpmAttributeSchema::z_scale_key, value)) {
+            size_t name_begin = value.find('[');
+            size_t name_end = value.find(']', name_begin);
+            size_t number_begin = value.find(") ", name_end);
+            if (name_begin != std::string_view::npos && name_end != std::string_view::npos &&
+                number_begin != std::string_view::npos) {
+                std::string_view number_unit = value.substr(number_begin + 2);
+                double number;
+                SpmParseError error = SpmNumberParser::parseVoltageV(number_unit, number);  // convert mV to V uniformly
+                if (error == SpmParseError::UnknownUnit) {
+                    error = SpmNumberParser::parseDouble(number_unit, number);  // 其他单位: 保留原始数值
+                }
+                if (error == SpmParseError::None) {
+                    return {number, std::string(value.substr(name_begin + 1, name_end - name_begin - 1))};
+                }
+            }
+        }
+
+        return {0, ""};
+    }
+
 public:
     // TODO: 1. 完善 Image Type
     enum class ImageType {
@@ -282,17 +706,6 @@ public:
     };
     static const std::vector<std::string> image_type_str;
 
-    // Can be modified: 可添加需要的属性正则表达式
-    const std::string data_length_regex = R"(\Data length: (\d+))";
-    const std::string data_offset_regex = R"(\Data offset: (\d+))";
-    const std::string bytes_per_pixel_regex = R"(\Bytes/pixel: ([24]))";
-    const std::string frame_direction_regex = R"(\Frame direction: ([A-Za-z]+))";
-    const std::string capture_start_line_regex = R"(\Capture start line: (\d+))";
-    const std::string color_table_index_regex = R"(\Color Table Index: (\d+))";
-    const std::string relative_frame_time_regex = R"(\Relative frame time: (\d+(\.\d+)?))";
-    const std::string samps_per_line_regex = R"(\Samps/line: (\d+))";
-    const std::string number_of_lines_regex = R"(\Number of lines: (\d+))";
-
 private:
     // Image attributes
     // Can be modified: 可添加需要的属性
@@ -312,7 +725,48 @@ private:
 
     // Image data
     std::vector<int> m_raw_data;  // uniformly converted to 4 bytes (int)
-    std::vector<std::vector<double>> m_real_data;
+    SpmHeightMap<double> m_real_data;
+    SpmHeightMap<float> m_real_data_f32;
+    DataPrecision m_data_precision = DataPrecision::Float64;
+    RawDataRetention m_raw_data_retention = RawDataRetention::Keep;
+    bool m_decoded = false;
+
+    // Image byte data source, released after decoding
+    std::shared_ptr<const void> m_source_owner;
+    const char *m_source_data = nullptr;
+    size_t m_source_size = 0;
+
+    // Decoded tile cache
+    std::shared_ptr<SpmTileCache> m_tile_cache;
+    SpmTileKey m_tile_key;
+};
+
+
+/**
+ * @brief 只解析文件头得到的 SPM 文件信息，不包含像素数据
+ */
+struct SpmProbeInfo {
+    struct Channel {
+        std::string image_type;
+        int rows{};
+        int cols{};
+        int bytes_per_pixel{};
+        unsigned int data_offset{};
+        unsigned int data_length{};
+    };
+
+    unsigned int scan_size{};
+    long long engage_x_pos_nm{};
+    long long engage_y_pos_nm{};
+    int x_offset_nm{};
+    int y_offset_nm{};
+    std::string date;  // 文件头中的采集时间，如 "10:00:00 AM Mon Mar 04 2024"
+    std::vector<Channel> channel_list;  // 按文件中的顺序
+
+    bool hasChannel(const std::string &image_type) const {
+        return std::any_of(channel_list.begin(), channel_list.end(),
+                           [&](const Channel &channel) { return channel.image_type == image_type; });
+    }
 };
 
 
@@ -346,35 +800,128 @@ public:
 
     ~SpmReader() = default;
 
+    SpmReader(const SpmReader &) = default;
+
+    SpmReader &operator=(const SpmReader &) = default;
+
+    SpmReader(SpmReader &&) = default;
+
+    SpmReader &operator=(SpmReader &&) = default;
+
 public:
+    enum class ReadMode {
+        Buffered,  // 打开一次文件，按数据偏移顺序将各通道读取到缓冲区
+        Mapped     // 内存映射整个文件，通道数据直接从映射内存中解码
+    };
+
+    void setReadMode(ReadMode read_mode) { m_read_mode = read_mode; }
+
+    ReadMode getReadMode() const { return m_read_mode; }
+
+    void setDataPrecision(SpmImage::DataPrecision data_precision) { m_data_precision = data_precision; }
+
+    SpmImage::DataPrecision getDataPrecision() const { return m_data_precision; }
+
+    void setRawDataRetention(SpmImage::RawDataRetention raw_data_retention) {
+        m_raw_data_retention = raw_data_retention;
+    }
+
+    SpmImage::RawDataRetention getRawDataRetention() const { return m_raw_data_retention; }
+
+    /**
+     * @brief 设置已解码图块的持久化缓存，readSpm() 读取的各通道在解码时自动查找 / 写入该缓存
+     */
+    void setTileCache(std::shared_ptr<SpmTileCache> tile_cache) { m_tile_cache = std::move(tile_cache); }
+
+    /**
+     * @brief 设置已读取到内存中的整个文件数据（如 SpmPrefetchReader 预读取的数据），下一次 readSpm() 直接从中解析，
+     * 不再访问文件；数据只使用一次，由各通道共享，全部通道解码后释放
+     */
+    void setFileData(std::shared_ptr<const std::vector<char>> file_data) { m_file_data = std::move(file_data); }
+
     std::string getSpmPath() const { return m_spm_path; }
 
     std::vector<std::string> getImageTypeList() const { return m_image_type_list; }
 
+    /**
+     * @brief 读取 SPM 文件：立即解析文件头，各通道像素数据延迟到第一次访问时解码
+     *
+     * @return true if successful
+     */
     bool readSpm() {
         if (m_spm_path.empty() || m_image_type_list.empty()) return false;
 
-        // spm file text structure: Head list + Image list x n
-        std::unordered_map<std::string, std::string> spm_file_text_map = loadSpmFileTextMap();
-        if (spm_file_text_map.size() < 2) {
-            return false;
+        // 已设置文件数据时直接使用内存中的数据; 映射模式直接在映射内存上扫描文件头;
+        // 缓冲模式只读取文件头字节，随后在同一次打开中继续读取像素数据
+        std::shared_ptr<const std::vector<char>> file_data = std::move(m_file_data);
+        std::shared_ptr<SpmMappedFile> mapped_file;
+        SpmFile spm_file;
+        std::string header_buffer;
+        std::string_view header;
+        if (file_data) {
+            header = std::string_view(file_data->data(), file_data->size());
+        } else if (m_read_mode == ReadMode::Mapped) {
+            mapped_file = std::make_shared<SpmMappedFile>();
+            if (!openMappedFile(*mapped_file)) {
+                std::cout << "Failed to map SPM file: " << m_spm_path << std::endl;
+                return false;
+            }
+            header = std::string_view(mapped_file->data(), mapped_file->size());
+        } else {
+            if (!openSpmFile(spm_file)) return false;
+            SpmHeaderScanner::readHeaderBytes(spm_file, header_buffer);
+            header = header_buffer;
         }
 
+        // spm file text structure: Head list + Image list x n
+        SpmHeaderScanner header_scanner;
+        if (!header_scanner.scan(header)) return false;
+
         // Parse SPM file text to file head attributes
-        parseFileHeadAttributes(spm_file_text_map.at("Head"));
-
-        // Parse SPM file text to image attributes and load SPM image data
-        for (auto &spm_file_text: spm_file_text_map) {
-            if (spm_file_text.first != "Head") {
-                SpmImage spm_image((int) m_scan_size);
-                spm_image.parseImageAttributes(spm_file_text.second);
-                spm_image.setZScale(spm_file_text.second, spm_file_text_map.at("Head"));
-                std::vector<char> byte_data = loadSpmImageData(spm_image);
-                bool status = spm_image.setImageData(byte_data);
-                if (!status) return false;
-
-                m_image_list.emplace(spm_file_text.first, std::move(spm_image));
+        SpmHeaderIndex head_index(header_scanner.head().text);
+        parseFileHeadAttributes(head_index);
+
+        // Parse SPM file text to image attributes
+        for (auto &section : header_scanner.imageList()) {
+            std::string image_type(section.image_type);
+            if (std::find(m_image_type_list.begin(), m_image_type_list.end(), image_type) == m_image_type_list.end()) {
+                continue;  // 不是需要的图像
+            }
+            if (m_image_list.find(image_type) != m_image_list.end()) continue;  // 同名通道只保留第一个
+
+            SpmHeaderIndex image_index(section.text);
+            SpmImage spm_image((int) m_scan_size);
+            spm_image.setDataPrecision(m_data_precision);
+            spm_image.setRawDataRetention(m_raw_data_retention);
+            if (!spm_image.parseImageAttributes(image_index)) {
+                std::cout << "SpmReader::readSpm() [Error]: Invalid image header \"" << image_type << "\": "
+                          << m_spm_path << std::endl;
+                m_image_list.clear();
+                return false;
             }
+            spm_image.setZScale(image_index, head_index);
+
+            SpmTileKey tile_key;
+            if (m_tile_cache && SpmTileCache::makeKey(m_spm_path, image_type,
+                                                      "decoded/" + getDataPrecisionTag(), tile_key)) {
+                spm_image.setTileCache(m_tile_cache, std::move(tile_key));
+            }
+
+            m_image_list.emplace(std::move(image_type), std::move(spm_image));
+        }
+
+        // Load SPM image data source, 此处只记录像素数据来源，像素数据在第一次访问时才解码
+        bool status;
+        if (file_data) {
+            status = setSharedImageSource(file_data, file_data->data(), file_data->size());
+        } else if (m_read_mode == ReadMode::Mapped) {
+            status = setSharedImageSource(mapped_file, mapped_file->data(), mapped_file->size());
+        } else {
+            status = loadBufferedImageSource(spm_file);
+        }
+        if (!status) {
+            m_image_list.clear();
+            return false;
         }
 
         if (m_image_list.empty()) return false;
@@ -382,6 +929,57 @@ public:
         return true;
     }
 
+    /**
+     * @brief 只读取并解析文件头（扫描尺寸、偏移、进针位置、全部通道及其尺寸与数据偏移），不读取像素数据
+     *
+     * 同时设置 getEngageXPosNM() / getXOffsetNM() 等文件头属性。
+     *
+     * @param probe_info The probe result.
+     * @return true if successful
+     */
+    bool probe(SpmProbeInfo &probe_info) {
+        if (m_spm_path.empty()) return false;
+
+        SpmFile spm_file;
+        if (!openSpmFile(spm_file)) return false;
+
+        std::string header_buffer;
+        SpmHeaderScanner::readHeaderBytes(spm_file, header_buffer);
+        spm_file.close();
+
+        SpmHeaderScanner header_scanner;
+        if (!header_scanner.scan(header_buffer)) return false;
+
+        SpmHeaderIndex head_index(header_scanner.head().text);
+        parseFileHeadAttributes(head_index);
+
+        probe_info = SpmProbeInfo();
+        probe_info.scan_size = m_scan_size;
+        probe_info.engage_x_pos_nm = m_engage_x_pos_nm;
+        probe_info.engage_y_pos_nm = m_engage_y_pos_nm;
+        probe_info.x_offset_nm = m_x_offset_nm;
+        probe_info.y_offset_nm = m_y_offset_nm;
+
+        std::string_view date;
+        if (head_index.getString(SpmAttributeSchema::date.key, date)) probe_info.date = std::string(date);
+
+        for (auto &section : header_scanner.imageList()) {
+            SpmImage spm_image((int) m_scan_size);
+            if (!spm_image.parseImageAttributes(SpmHeaderIndex(section.text))) continue;  // 无法解码的通道
+
+            SpmProbeInfo::Channel channel;
+            channel.image_type = section.image_type;
+            channel.rows = spm_image.getRows();
+            channel.cols = spm_image.getCols();
+            channel.bytes_per_pixel = spm_image.getBytesPerPixel();
+            channel.data_offset = spm_image.getDataOffset();
+            channel.data_length = spm_image.getDataLength();
+            probe_info.channel_list.emplace_back(std::move(channel));
+        }
+
+        return true;
+    }
+
     // Suitable for single channel
     bool isImageAvailableSingle() {
         return m_image_list.begin() != m_image_list.end();
@@ -409,18 +1007,90 @@ public:
     }
 
     // Suitable for single channel
-    std::vector<std::vector<double>> &getImageRealDataSingle() {
+    SpmHeightMap<double> &getImageRealDataSingle() {
         return m_image_list.begin()->second.getRealData();
     }
 
-    std::vector<std::vector<double>> &getImageRealData(const std::string &image_type) {
+    SpmHeightMap<double> &getImageRealData(const std::string &image_type) {
         return m_image_list.at(image_type).getRealData();
     }
 
-    std::vector<std::vector<double>> &getImageRealData(const SpmImage::ImageType &image_type) {
+    SpmHeightMap<double> &getImageRealData(const SpmImage::ImageType &image_type) {
         return m_image_list.at(SpmImage::image_type_str[(int) image_type]).getRealData();
     }
 
+    /**
+     * @brief 将通道的 real data 导出为 .npy 文件
+     *
+     * 元素类型与存储精度一致（Float64 为 <f8，Float32 为 <f4），行顺序与 getRealData() 一致。
+     * 数据从连续的 real data 缓冲区一次写出，可用 numpy.load(npy_path, mmap_mode='r') 直接映射。
+     *
+     * @param npy_path UTF-8 path
+     */
+    bool exportRealDataNpy(const std::string &image_type, const std::string &npy_path) {
+        auto image_iter = m_image_list.find(image_type);
+        if (image_iter == m_image_list.end()) {
+            std::cout << "SpmReader::exportRealDataNpy() [Error]: No image type: " << image_type << std::endl;
+            return false;
+        }
+
+        SpmImage &spm_image = image_iter->second;
+        if (spm_image.getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            return SpmNpy::write(npy_path, spm_image.getRealDataF32());
+        }
+        return SpmNpy::write(npy_path, spm_image.getRealData());
+    }
+
+    /**
+     * @brief 将通道的 raw data 导出为 .npy 文件（<i4，行顺序为文件中的原始顺序，未翻转）
+     *
+     * Note: 需要 Keep 或 RawOnly 方式，Drop 方式下没有 raw data
+     *
+     * @param npy_path UTF-8 path
+     */
+    bool exportRawDataNpy(const std::string &image_type, const std::string &npy_path) {
+        auto image_iter = m_image_list.find(image_type);
+        if (image_iter == m_image_list.end()) {
+            std::cout << "SpmReader::exportRawDataNpy() [Error]: No image type: " << image_type << std::endl;
+            return false;
+        }
+
+        SpmImage &spm_image = image_iter->second;
+        std::vector<int> &raw_data = spm_image.getRawData();
+        if (raw_data.empty()) {
+            std::cout << "SpmReader::exportRawDataNpy() [Error]: Raw data is not retained: " << m_spm_path
+                      << std::endl;
+            return false;
+        }
+        return SpmNpy::write(npy_path, raw_data, spm_image.getRows(), spm_image.getCols());
+    }
+
+    /**
+     * @brief 将多个文件中同一通道的 real data 导出为一个 shape 为 (n, rows, cols) 的 .npy 文件
+     *
+     * 各图块按行条带流式解码后直接写入（见 SpmImage::decodeStrips()），不生成整幅图像。
+     * 所有图块的尺寸须相同，元素类型取第一个文件的存储精度。reader_list 须已调用 readSpm()。
+     *
+     * @param npy_path UTF-8 path
+     */
+    static bool exportRealDataNpyStack(std::vector<SpmReader> &reader_list, const std::string &image_type,
+                                       const std::string &npy_path) {
+        if (reader_list.empty()) {
+            std::cout << "SpmReader::exportRealDataNpyStack() [Error]: Empty reader list" << std::endl;
+            return false;
+        }
+
+        if (reader_list[0].getDataPrecision() == SpmImage::DataPrecision::Float32) {
+            return exportRealDataNpyStackImpl<float>(reader_list, image_type, npy_path);
+        }
+        return exportRealDataNpyStackImpl<double>(reader_list, image_type, npy_path);
+    }
+
+    // 缓存键中使用的存储精度标识
+    std::string getDataPrecisionTag() const {
+        return SpmImage::getDataPrecisionTag(m_data_precision);
+    }
+
     long long getEngageXPosNM() const { return m_engage_x_pos_nm; }
 
     long long getEngageYPosNM() const { return m_engage_y_pos_nm; }
@@ -430,108 +1100,124 @@ public:
     int getYOffsetNM() const { return m_y_offset_nm; }
 
 private:
-    std::unordered_map<std::string, std::string> loadSpmFileTextMap() {
-
-#ifdef _MSC_VER
-        FILE *spm_file = nullptr;
-        errno_t err = _wfopen_s(&spm_file, string2wstring(m_spm_path).c_str(), L"r");
-#else
-        FILE *spm_file = _wfopen(string2wstring(m_spm_path).c_str(), L"r");
-#endif
-
-        if (!spm_file) {
+    /**
+     * @brief 以只读方式打开 SPM 文件，m_spm_path 为 UTF-8 编码
+     */
+    bool openSpmFile(SpmFile &spm_file) const {
+        if (!spm_file.open(SpmFile::fromUtf8(m_spm_path))) {
             std::cout << "Failed to open SPM file: " << m_spm_path << std::endl;
-            return {};
-        }
-
-        std::unordered_map<std::string, std::string> text_map;
-        std::string text, line;
-        std::wstring line_w;
-        wchar_t buffer[1024];
-        while (fgetws(buffer, sizeof(buffer) / sizeof(buffer[0]), spm_file)) {
-            line_w = buffer;
-            line = wstring2string(line_w);
-            line.assign(line.begin(), line.end() - 1);  // 去除 '\n'
-            if (line.substr(0, 2) == "\\*") {
-                if (line == m_file_list_end_str) {  // end, last Image list
-                    std::string image_type = getStringFromTextByRegex(image_type_regex, text);
-                    auto image_type_it = std::find(m_image_type_list.begin(), m_image_type_list.end(), image_type);
-                    if (image_type_it != m_image_type_list.end()) {  // 是需要的图像
-                        text_map.emplace(image_type, text);
-                    }
-                    break;
-                }
-                if (line == m_ciao_image_list_str) {
-                    if (text_map.empty()) {  // Head list
-                        text_map.emplace("Head", text);
-                    } else {  // !text_map.empty(), Image list
-                        std::string image_type = getStringFromTextByRegex(image_type_regex, text);
-                        auto image_type_it = std::find(m_image_type_list.begin(), m_image_type_list.end(), image_type);
-                        if (image_type_it != m_image_type_list.end()) {  // 是需要的图像
-                            text_map.emplace(image_type, text);
-                        }
-                    }
-                    text.clear();
-                }
-            }
-            text.append(line);
-            text.append("\n");
+            return false;
         }
 
-        fclose(spm_file);
-
-        return text_map;
+        return true;
     }
 
-    std::vector<char> loadSpmImageData(SpmImage &spm_image) {
+    /**
+     * @brief 映射模式 / 内存数据: 整个文件只保存一份（映射或内存数据），各通道共享，全部通道解码后释放
+     *
+     * @param owner The owner of the file data.
+     * @param file_data The whole file data.
+     * @param file_size The size of the file data.
+     * @return true if all channels are within the file data
+     */
+    bool setSharedImageSource(const std::shared_ptr<const void> &owner, const char *file_data, size_t file_size) {
+        for (auto &spm_image_pair : m_image_list) {
+            SpmImage &spm_image = spm_image_pair.second;
+            size_t data_offset = spm_image.getDataOffset();
+            size_t data_length = spm_image.getDataLength();
+            if (data_offset > file_size || data_length > file_size - data_offset) return false;
+            if (!spm_image.isImageSourceValid(data_length)) return false;
+            spm_image.setImageSource(owner, file_data + data_offset, data_length);
+        }
 
-#ifdef _MSC_VER
-        FILE *spm_file = nullptr;
-        errno_t err = _wfopen_s(&spm_file, string2wstring(m_spm_path).c_str(), L"rb");
-#else
-        FILE *spm_file = _wfopen(string2wstring(m_spm_path).c_str(), L"rb");
-#endif
+        return true;
+    }
 
-        if (!spm_file) {
-            std::cout << "Failed to open SPM file: " << m_spm_path << std::endl;
-            return {};
+    /**
+     * @brief 缓冲模式: 在读取文件头的同一次打开中，按 Data offset 排序后顺序读取所有通道的数据
+     */
+    bool loadBufferedImageSource(const SpmFile &spm_file) {
+        std::vector<SpmImage *> spm_image_list;
+        for (auto &spm_image_pair : m_image_list) {
+            spm_image_list.emplace_back(&spm_image_pair.second);
+        }
+        std::sort(spm_image_list.begin(), spm_image_list.end(), [](const SpmImage *a, const SpmImage *b) {
+            return a->getDataOffset() < b->getDataOffset();
+        });
+
+        for (SpmImage *spm_image : spm_image_list) {
+            // 按偏移读取，通道数据之间的间隔直接跳过
+            auto byte_data = std::make_shared<std::vector<char>>(spm_image->getDataLength());
+            size_t read_size = spm_file.readAt(spm_image->getDataOffset(), byte_data->data(), byte_data->size());
+            byte_data->resize(read_size);
+
+            if (!spm_image->isImageSourceValid(byte_data->size())) return false;
+            spm_image->setImageSource(byte_data, byte_data->data(), byte_data->size());
         }
 
-        std::vector<char> jump_over(spm_image.getDataOffset());
-        fread(jump_over.data(), 1, spm_image.getDataOffset(), spm_file);
+        return true;
+    }
+
+    bool openMappedFile(SpmMappedFile &mapped_file) const {
+        return mapped_file.open(SpmFile::fromUtf8(m_spm_path));
+    }
 
-        std::vector<char> image_data(spm_image.getDataLength());
-        fread(image_data.data(), 1, spm_image.getDataLength(), spm_file);
+    template<typename T>
+    static bool exportRealDataNpyStackImpl(std::vector<SpmReader> &reader_list, const std::string &image_type,
+                                           const std::string &npy_path) {
+        SpmNpyStackWriter<T> npy_writer;
+        for (size_t i = 0; i < reader_list.size(); ++i) {
+            SpmReader &spm_reader = reader_list[i];
+            auto image_iter = spm_reader.m_image_list.find(image_type);
+            if (image_iter == spm_reader.m_image_list.end()) {
+                std::cout << "SpmReader::exportRealDataNpyStack() [Error]: No image type \"" << image_type
+                          << "\" in: " << spm_reader.m_spm_path << std::endl;
+                return false;
+            }
 
-        fclose(spm_file);
+            SpmImage &spm_image = image_iter->second;
+            if (i == 0 && !npy_writer.open(npy_path, reader_list.size(), spm_image.getRows(), spm_image.getCols())) {
+                return false;
+            }
+            if (spm_image.getRows() != npy_writer.getRows() || spm_image.getCols() != npy_writer.getCols()) {
+                std::cout << "SpmReader::exportRealDataNpyStack() [Error]: Image size does not match: "
+                          << spm_reader.m_spm_path << std::endl;
+                return false;
+            }
 
-        return image_data;
-    }
+            bool write_status = true;
+            bool decode_status = spm_image.decodeStrips<T>(
+                    SpmImage::default_strip_rows, [&](int, const SpmHeightMapView<T> &strip) {
+                        write_status = write_status && npy_writer.appendRows(strip);
+                    });
+            if (!decode_status || !write_status) {
+                std::cout << "SpmReader::exportRealDataNpyStack() [Error]: Failed to export: "
+                          << spm_reader.m_spm_path << std::endl;
+                return false;
+            }
+        }
 
-    void parseFileHeadAttributes(std::string &spm_file_text) {
-        // Can be modified: 可添加需要的属性
-        m_scan_size = getIntFromTextByRegex(scan_size_regex, spm_file_text);
-        m_engage_x_pos_nm = getLongLongFromTextByRegexToNM(engage_x_pos_regex, spm_file_text);
-        m_engage_y_pos_nm = getLongLongFromTextByRegexToNM(engage_y_pos_regex, spm_file_text);
-        m_x_offset_nm = getIntFromTextByRegex(x_offset_regex, spm_file_text);
-        m_y_offset_nm = getIntFromTextByRegex(y_offset_regex, spm_file_text);
+        return npy_writer.close();
     }
 
-public:
-    // Can be modified: 可添加需要的属性正则表达式
-    const std::string image_type_regex = R"(\@2:Image Data: S \[.*?\] \"(.*?)\")";
-    const std::string scan_size_regex = R"(\Scan Size: (\d+(\.\d+)?) nm)";
-    const std::string engage_x_pos_regex = R"(\\Engage X Pos: ([0-9.-]*) ([num]*))";
-    const std::string engage_y_pos_regex = R"(\\Engage Y Pos: ([0-9.-]*) ([num]*))";
-    const std::string x_offset_regex = R"(\\X Offset: ([0-9.-]*) ([num]*))";
-    const std::string y_offset_regex = R"(\\Y Offset: ([0-9.-]*) ([num]*))";
+    void parseFileHeadAttributes(const SpmHeaderIndex &head_index) {
+        // Can be modified: 可添加需要的属性（同时在 SpmAttributeSchema 中添加）
+        using Schema = SpmAttributeSchema;
+        m_scan_size = Schema::get<unsigned int>(head_index, Schema::scan_size);
+        m_engage_x_pos_nm = Schema::get<long long>(head_index, Schema::engage_x_pos);
+        m_engage_y_pos_nm = Schema::get<long long>(head_index, Schema::engage_y_pos);
+        m_x_offset_nm = Schema::get<int>(head_index, Schema::x_offset);
+        m_y_offset_nm = Schema::get<int>(head_index, Schema::y_offset);
+    }
 
 private:
     std::string m_spm_path;
     std::vector<std::string> m_image_type_list;
-
-    const std::string m_file_list_end_str = "\\*File list end";
-    const std::string m_ciao_image_list_str = "\\*Ciao image list";
+    ReadMode m_read_mode = ReadMode::Mapped;
+    SpmImage::DataPrecision m_data_precision = SpmImage::DataPrecision::Float64;
+    SpmImage::RawDataRetention m_raw_data_retention = SpmImage::RawDataRetention::Keep;
+    std::shared_ptr<SpmTileCache> m_tile_cache;
+    std::shared_ptr<const std::vector<char>> m_file_data;
 
     // File head general attributes
     // Can be modified: 可添加需要的属性
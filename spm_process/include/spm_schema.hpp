@@ -0,0 +1,135 @@
+#ifndef SPM_SCHEMA_HPP
+#define SPM_SCHEMA_HPP
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "spm_header.hpp"
+
+
+// 文件头属性值的类型与单位处理方式
+enum class SpmAttributeType {
+    Int,       // 整数，如 "Data length: 8192"
+    Double,    // 浮点数，如 "Relative frame time: 1.5"
+    String,    // 第一个空白之前的文本，如 "Frame direction: Down"
+    LengthNM   // 带长度单位的数值，统一换算为 nm，如 "Engage X Pos: -19783.4 um"
+};
+
+
+struct SpmAttributeSpec {
+    std::string_view key;  // 去掉前导 '\' 的属性名称
+    SpmAttributeType type;
+};
+
+
+/**
+ * @brief SPM 文件头属性表
+ *
+ * 所有实例共享的编译期常量，取代每个 SpmImage / SpmReader 实例中保存的正则表达式字符串。
+ * 解析时按属性表中的 key 直接在 SpmHeaderIndex 中查找，并按 type 转换数值，不构造正则表达式。
+ */
+class SpmAttributeSchema {
+private:
+    SpmAttributeSchema() = default;
+
+    ~SpmAttributeSchema() = default;
+
+public:
+    // Can be modified: 可添加需要的属性
+    // Head list
+    static constexpr SpmAttributeSpec scan_size{"Scan Size", SpmAttributeType::LengthNM};
+    static constexpr SpmAttributeSpec engage_x_pos{"Engage X Pos", SpmAttributeType::LengthNM};
+    static constexpr SpmAttributeSpec engage_y_pos{"Engage Y Pos", SpmAttributeType::LengthNM};
+    static constexpr SpmAttributeSpec x_offset{"X Offset", SpmAttributeType::LengthNM};
+    static constexpr SpmAttributeSpec y_offset{"Y Offset", SpmAttributeType::LengthNM};
+    static constexpr SpmAttributeSpec date{"Date", SpmAttributeType::String};  // 值中含空格，需读取完整的原始文本
+
+    // Image list
+    static constexpr SpmAttributeSpec data_length{"Data length", SpmAttributeType::Int};
+    static constexpr SpmAttributeSpec data_offset{"Data offset", SpmAttributeType::Int};
+    static constexpr SpmAttributeSpec bytes_per_pixel{"Bytes/pixel", SpmAttributeType::Int};
+    static constexpr SpmAttributeSpec frame_direction{"Frame direction", SpmAttributeType::String};
+    static constexpr SpmAttributeSpec capture_start_line{"Capture start line", SpmAttributeType::Int};
+    static constexpr SpmAttributeSpec color_table_index{"Color Table Index", SpmAttributeType::Int};
+    static constexpr SpmAttributeSpec relative_frame_time{"Relative frame time", SpmAttributeType::Double};
+    static constexpr SpmAttributeSpec samps_per_line{"Samps/line", SpmAttributeType::Int};
+    static constexpr SpmAttributeSpec number_of_lines{"Number of lines", SpmAttributeType::Int};
+
+    // "@2:Z scale" 的值形如 V [Sens. ZsensSens] (0.006713867 V/LSB) 2.000000 V，由 SpmImage::setZScale() 专门解析
+    static constexpr std::string_view z_scale_key = "@2:Z scale";
+
+    static constexpr std::array<SpmAttributeSpec, 5> head_attribute_list{
+            scan_size, engage_x_pos, engage_y_pos, x_offset, y_offset
+    };
+
+    static constexpr std::array<SpmAttributeSpec, 9> image_attribute_list{
+            data_length, data_offset, bytes_per_pixel, frame_direction, capture_start_line, color_table_index,
+            relative_frame_time, samps_per_line, number_of_lines
+    };
+
+    // 解码像素数据必需的图像属性，缺失时该通道无法读取
+    static constexpr std::array<SpmAttributeSpec, 5> required_image_attribute_list{
+            data_length, data_offset, bytes_per_pixel, samps_per_line, number_of_lines
+    };
+
+public:
+    /**
+     * @brief 按属性表读取属性值
+     *
+     * @param index The header section index.
+     * @param spec The attribute spec.
+     * @param value The attribute value, unchanged if not found.
+     * @return true if the attribute is found and converted
+     */
+    template<typename T>
+    static bool read(const SpmHeaderIndex &index, const SpmAttributeSpec &spec, T &value) {
+        if constexpr (std::is_same_v<T, std::string>) {
+            std::string_view value_str;
+            if (!index.getString(spec.key, value_str)) return false;
+
+            // 取第一个空白之前的部分
+            value = std::string(value_str.substr(0, value_str.find(' ')));
+            return true;
+        } else {
+            static_assert(std::is_arithmetic_v<T>, "Attribute value must be arithmetic or std::string");
+
+            switch (spec.type) {
+                case SpmAttributeType::Int: {
+                    long long number;
+                    if (!index.getLongLong(spec.key, number)) return false;
+                    value = static_cast<T>(number);
+                    return true;
+                }
+                case SpmAttributeType::Double: {
+                    double number;
+                    if (!index.getDouble(spec.key, number)) return false;
+                    value = static_cast<T>(number);
+                    return true;
+                }
+                case SpmAttributeType::LengthNM: {
+                    long long number;
+                    if (!index.getLongLongToNM(spec.key, number)) return false;
+                    value = static_cast<T>(number);
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+
+    /**
+     * @brief 按属性表读取属性值，不存在时返回 T()
+     */
+    template<typename T>
+    static T get(const SpmHeaderIndex &index, const SpmAttributeSpec &spec) {
+        T value{};
+        read(index, spec, value);
+        return value;
+    }
+};
+
+
+#endif //SPM_SCHEMA_HPP
@@ -2,70 +2,191 @@
 #define SPM_STITCHING_HPP
 
 #include "spm_algorithm.hpp"
+#include "spm_grid_stitcher.hpp"
+#include "spm_parallel.hpp"
+#include "spm_prefetch.hpp"
+#include "spm_tile_store.hpp"
+
+#include <memory>
 
 
 class SpmStitching : public SpmRegexParse, StringOperations {
 public:
+    // 图像拼接方式
+    enum class StitchingMethod {
+        Grid,     // 由载物台坐标预测位置、互相关配准的平移拼接（SpmGridStitcher），失败时回退到 Panorama
+        Panorama  // cv::Stitcher 全景拼接，不使用 SPM 文件头中的位置信息
+    };
+
     SpmStitching() = default;
 
     ~SpmStitching() = default;
 
 public:
+    /**
+     * @brief 设置 loadSpmfromSpmPath() 读取图像时的 real data 存储精度
+     *
+     * Float32 可使每个图块的内存占用减半，z scale 等计算仍以 double 进行。
+     */
+    void setDataPrecision(SpmImage::DataPrecision data_precision) { m_data_precision = data_precision; }
+
+    /**
+     * @brief 设置 loadSpmfromSpmPath() 读取图像时 raw data 的保留方式，拼接不读取 raw data，默认为 Drop
+     */
+    void setRawDataRetention(SpmImage::RawDataRetention raw_data_retention) {
+        m_raw_data_retention = raw_data_retention;
+    }
+
+    /**
+     * @brief 设置 loadSpmfromSpmPath() 的拉平方式，默认为逐行一阶拉平（Line, 1）
+     *
+     * @param mode SpmFlatten::Mode::Line or SpmFlatten::Mode::Surface.
+     * @param order The polynomial order, [0, SpmFlatten::max_order]. Surface 1 is plane flattening.
+     */
+    void setFlatten(SpmFlatten::Mode mode, int order) {
+        m_flatten_mode = mode;
+        m_flatten_order = order;
+    }
+
+    /**
+     * @brief 设置 loadSpmfromSpmPath() 拉平时的稳健拟合参数，默认开启，避免颗粒、台阶等拉偏拟合而影响配准
+     *
+     * @param robust The robust fitting parameters, SpmFlatten::Robust{0} to disable.
+     */
+    void setFlattenRobust(const SpmFlatten::Robust &robust) { m_flatten_robust = robust; }
+
+    /**
+     * @brief 设置 loadSpmfromSpmPath() 并行读取文件的最大线程数，<= 0 表示使用硬件并发线程数
+     */
+    void setMaxWorkers(int max_workers) { m_max_workers = max_workers; }
+
+    /**
+     * @brief 设置图像拼接方式，默认为 Grid
+     */
+    void setStitchingMethod(StitchingMethod stitching_method) { m_stitching_method = stitching_method; }
+
+    /**
+     * @brief 设置 Grid 拼接方式的参数，max_workers <= 0 时使用 setMaxWorkers() 的设置
+     */
+    void setGridStitchParams(const SpmGridStitcher::Params &grid_params) { m_grid_params = grid_params; }
+
+    /**
+     * @brief 设置已拉平图块的持久化缓存，loadSpmfromSpmPath() 命中缓存时跳过解码与拉平
+     */
+    void setTileCache(std::shared_ptr<SpmTileCache> tile_cache) { m_tile_cache = std::move(tile_cache); }
+
+    /**
+     * @brief 设置 loadSpmfromSpmPath() 的异步预读取，后台线程提前读取后续文件，与解码、拉平重叠进行，默认关闭
+     *
+     * Note: 预读取由单个线程按顺序读取整个文件（含未使用的通道），而默认的映射方式由各工作线程并行读取，
+     * 且只访问所需通道的数据；多通道文件或本地存储上预读取通常更慢，只在顺序读取明显更快的慢速存储上按需开启。
+     *
+     * @param depth The maximum number of files read ahead, <= 0 to disable.
+     * @param max_bytes The maximum bytes of files read ahead but not yet processed.
+     */
+    void setPrefetch(int depth, unsigned long long max_bytes = SpmPrefetchReader::default_max_bytes) {
+        m_prefetch_depth = depth;
+        m_prefetch_max_bytes = max_bytes;
+    }
+
+    /**
+     * @brief 并行读取 SPM 文件，进行拉平处理（见 setFlatten()）并转为图像
+     *
+     * 输出列表的顺序与 spm_path_list 一致；读取失败的文件逐个报告，并返回 false，此时输出列表中只包含读取成功的文件。
+     * 拉平后的数据直接转交给输出的图像（不拷贝），SpmReader 中只保留图像属性。
+     */
     bool loadSpmfromSpmPath(std::vector<std::string> &spm_path_list, const std::string &image_type,
                             std::vector<SpmReader> &spm_reader_list, std::vector<cv::Mat> &image_f1_list) {
-        // 实例化 spm 对象，进行一阶拉平处理并保存图像
-        spm_reader_list.clear();
         image_f1_list.clear();
 
-        for (auto &i : spm_path_list) {
-            SpmReader spm(i, image_type);
-            if (!spm.readSpm()) {
-                std::cout << "loadSpmfromSpmPath() [Error]: Failed to read SPM file: " << i << std::endl;
-                return false;
-            }
+        std::vector<cv::Mat> image_list(spm_path_list.size());
+        std::vector<char> loaded_list;
+        bool status = loadFlattenedSpm(spm_path_list, image_type, spm_reader_list, loaded_list,
+                                       [&](size_t i, SpmImage &spm_image) {
+                                           image_list[i] = SpmAlgorithm::takeSpmImageToImage(spm_image);
+                                           return !image_list[i].empty();
+                                       });
 
-            auto &spm_image = spm.getImageSingle();
-            SpmAlgorithm::flattenFirst(spm_image);
-            cv::Mat image = SpmAlgorithm::spmImageToImage(spm_image);
-
-            // add
-            image_f1_list.emplace_back(image);
-            spm_reader_list.emplace_back(std::move(spm));
+        for (size_t i = 0; i < loaded_list.size(); ++i) {
+            if (loaded_list[i]) image_f1_list.emplace_back(std::move(image_list[i]));
         }
 
-        return true;
+        return status;
     }
 
-    std::vector<std::vector<double>> execStitchingImage(std::vector<cv::Mat> &image_f1_list,
-                                                        cv::Mat *stitched_image = nullptr) {
-        // 图像数据拼接
-        int stitching_status;
-        auto stitching_image_data = stitchingImage(image_f1_list, &stitching_status);
-        if (stitching_status != 0) {
-            std::cout << "execStitchingImage() [Error]: Image stitching failed! Status code: "
-                      << stitching_status << std::endl;
-            return {};
+    /**
+     * @brief 同上，拉平后的图像压缩保存到 tile_store 中（顺序与 spm_reader_list 一致），并释放 SpmReader 中的图像数据
+     *
+     * 读取过程中只有各线程正在处理的图块以未压缩形式存在，适用于图块数量较多的场景。
+     */
+    bool loadSpmfromSpmPath(std::vector<std::string> &spm_path_list, const std::string &image_type,
+                            std::vector<SpmReader> &spm_reader_list, SpmTileStore &tile_store) {
+        tile_store.clear();
+        tile_store.resize(spm_path_list.size());
+
+        std::vector<char> loaded_list;
+        bool status = loadFlattenedSpm(spm_path_list, image_type, spm_reader_list, loaded_list,
+                                       [&](size_t i, SpmImage &spm_image) {
+                                           bool stored = tile_store.put(i, SpmAlgorithm::spmImageToImageView(spm_image));
+                                           spm_image.releaseImageData();
+                                           return stored;
+                                       });
+
+        // 移除读取失败的文件
+        for (size_t i = loaded_list.size(); i-- > 0;) {
+            if (!loaded_list[i]) tile_store.erase(i);
         }
 
-        if (stitched_image) {
-            cv::Mat _stitched_image = SpmAlgorithm::array2DToImage(stitching_image_data);
-            cv::normalize(_stitched_image, _stitched_image, 255, 0, cv::NORM_MINMAX, CV_8U);
-            _stitched_image.copyTo(*stitched_image);
+        return status;
+    }
+
+    /**
+     * @brief 拼接图像，按 setStitchingMethod() 的设置选择拼接方式
+     *
+     * @param spm_reader_list The SPM readers of the images (same order), used for the stage positions.
+     * @param image_f1_list The flattened images.
+     * @param stitched_image If not null, receives the stitched image normalized to CV_8U.
+     * @return the stitched height data, empty if failed
+     */
+    SpmHeightMap<double> execStitchingImage(std::vector<SpmReader> &spm_reader_list,
+                                            std::vector<cv::Mat> &image_f1_list,
+                                            cv::Mat *stitched_image = nullptr) {
+        int stitching_status = -1;
+        SpmHeightMap<double> stitching_image_data;
+        if (m_stitching_method == StitchingMethod::Grid) {
+            stitching_image_data = stitchingImageGrid(spm_reader_list, image_f1_list, &stitching_status);
+            if (stitching_status != 0) {
+                std::cout << "execStitchingImage() [Warning]: Grid stitching failed (status code: "
+                          << stitching_status << "), falling back to cv::Stitcher." << std::endl;
+            }
         }
+        if (stitching_status != 0) stitching_image_data = stitchingImage(image_f1_list, &stitching_status);
 
-        return stitching_image_data;
+        return finishStitchingImage(std::move(stitching_image_data), stitching_status, stitched_image);
+    }
+
+    /**
+     * @brief 使用 cv::Stitcher 拼接图像（无 SPM 文件头中的位置信息）
+     */
+    SpmHeightMap<double> execStitchingImage(std::vector<cv::Mat> &image_f1_list,
+                                            cv::Mat *stitched_image = nullptr) {
+        int stitching_status;
+        auto stitching_image_data = stitchingImage(image_f1_list, &stitching_status);
+
+        return finishStitchingImage(std::move(stitching_image_data), stitching_status, stitched_image);
     }
 
     bool execStitching(std::vector<SpmReader> &spm_reader_list,
                        std::vector<cv::Mat> &image_f1_list,
                        const std::string &output_spm_path,
                        cv::Mat *stitched_image = nullptr) {
-        std::vector<std::vector<double>> stitching_image_data = execStitchingImage(image_f1_list, stitched_image);
+        SpmHeightMap<double> stitching_image_data = execStitchingImage(spm_reader_list, image_f1_list,
+                                                                       stitched_image);
         if (stitching_image_data.empty()) return false;
 
         // 计算新的 scan size
         auto &spm_image_first = spm_reader_list[0].getImageSingle();
-        int new_scan_size = (int) ((double) stitching_image_data.size() * spm_image_first.getScanSize() / spm_image_first.getRows());
+        int new_scan_size = (int) ((double) stitching_image_data.rows() * spm_image_first.getScanSize() / spm_image_first.getRows());
 
         // 计算新的 z scale 并 保留 7 位小数 + .1
         double z_scale = calcNewZScale(spm_reader_list[0], stitching_image_data) * 1.5;  // "x1.5" 以避免超量程
@@ -79,8 +200,8 @@ public:
         if (!buildOutputSpmHeader(spm_reader_list[0].getSpmPath(), output_spm_path,
                                   spm_reader_list[0].getImageTypeList()[0],
                                   (int) byte_data.size(), z_scale,
-                                  (int) stitching_image_data[0].size(),
-                                  (int) stitching_image_data.size(), new_scan_size)) {
+                                  stitching_image_data.cols(),
+                                  stitching_image_data.rows(), new_scan_size)) {
             std::cout << "execStitching() [Error]: Failed to build output SPM header." << std::endl;
             return false;
         }
@@ -95,7 +216,92 @@ public:
     }
 
 private:
-    static std::vector<std::vector<double>> stitchingImage(std::vector<cv::Mat> &image_f1_list, int *status = nullptr) {
+    /**
+     * @brief 并行读取 SPM 文件并进行拉平处理，store_image(i, spm_image) 在工作线程中保存第 i 个文件的图像
+     *
+     * @param loaded_list The per-file status, 1 if the file is loaded and appended to spm_reader_list.
+     * @param store_image The image callback, returns false if the image cannot be stored.
+     * @return true if all files are loaded
+     */
+    template<typename Fn>
+    bool loadFlattenedSpm(const std::vector<std::string> &spm_path_list, const std::string &image_type,
+                          std::vector<SpmReader> &spm_reader_list, std::vector<char> &loaded_list, Fn &&store_image) {
+        // 实例化 spm 对象，进行拉平处理并保存图像
+        spm_reader_list.clear();
+        loaded_list.assign(spm_path_list.size(), 0);
+
+        std::vector<std::unique_ptr<SpmReader>> spm_list(spm_path_list.size());
+
+        // 缓存键包含处理参数，命中时直接得到拉平后的数据
+        std::vector<SpmTileKey> tile_key_list(spm_path_list.size());
+        std::vector<char> use_cache_list(spm_path_list.size(), 0);
+        if (m_tile_cache) {
+            std::string flatten_tag = SpmFlatten::getProcessingTag(m_flatten_mode, m_flatten_order, m_flatten_robust);
+            std::string processing = flatten_tag + "/" + SpmImage::getDataPrecisionTag(m_data_precision);
+            for (size_t i = 0; i < spm_path_list.size(); ++i) {
+                use_cache_list[i] = SpmTileCache::makeKey(spm_path_list[i], image_type, processing, tile_key_list[i]);
+            }
+        }
+
+        // 预读取缓存中没有的文件
+        std::unique_ptr<SpmPrefetchReader> prefetch_reader;
+        if (m_prefetch_depth > 0) {
+            std::vector<std::string> prefetch_path_list(spm_path_list.size());
+            for (size_t i = 0; i < spm_path_list.size(); ++i) {
+                if (!use_cache_list[i] || !m_tile_cache->contains(tile_key_list[i])) {
+                    prefetch_path_list[i] = spm_path_list[i];
+                }
+            }
+            prefetch_reader = std::make_unique<SpmPrefetchReader>(std::move(prefetch_path_list), m_prefetch_depth,
+                                                                  m_prefetch_max_bytes);
+        }
+
+        // 文件数少于线程数时，剩余的线程用于单个图像内按行并行拉平
+        int max_workers = m_max_workers > 0 ? m_max_workers : SpmParallel::defaultWorkerCount();
+        int flatten_workers = std::max(1, max_workers / (int) std::max<size_t>(1, spm_path_list.size()));
+
+        SpmParallel::forEachIndex(spm_path_list.size(), m_max_workers, [&](size_t i) {
+            auto spm = std::make_unique<SpmReader>(spm_path_list[i], image_type);
+            spm->setDataPrecision(m_data_precision);
+            spm->setRawDataRetention(m_raw_data_retention);
+            if (prefetch_reader) spm->setFileData(prefetch_reader->take(i));  // 未预读取时为空，readSpm() 直接读取文件
+            if (!spm->readSpm()) return;
+
+            auto &spm_image = spm->getImageSingle();
+
+            bool use_cache = use_cache_list[i] != 0;
+            if (!use_cache || !spm_image.loadRealDataFromCache(*m_tile_cache, tile_key_list[i])) {
+                if (!SpmAlgorithm::flatten(spm_image, m_flatten_mode, m_flatten_order, m_flatten_robust, {},
+                                           flatten_workers)) {
+                    return;
+                }
+                if (use_cache) spm_image.storeRealDataToCache(*m_tile_cache, tile_key_list[i]);
+            }
+
+            if (!store_image(i, spm_image)) return;
+
+            spm_list[i] = std::move(spm);
+        });
+
+        // 按输入顺序汇总结果
+        bool status = true;
+        for (size_t i = 0; i < spm_path_list.size(); ++i) {
+            if (!spm_list[i]) {
+                std::cout << "loadSpmfromSpmPath() [Error]: Failed to read SPM file: " << spm_path_list[i] << std::endl;
+                status = false;
+                continue;
+            }
+
+            // add
+            loaded_list[i] = 1;
+            spm_reader_list.emplace_back(std::move(*spm_list[i]));
+        }
+
+        return status;
+    }
+
+
+    static SpmHeightMap<double> stitchingImage(std::vector<cv::Mat> &image_f1_list, int *status = nullptr) {
         if (image_f1_list.empty()) {
             std::cout << "stitchingImage() [Error]: Input image list is empty." << std::endl;
             if (status) *status = -1;
@@ -169,35 +375,87 @@ private:
         pano.convertTo(pano, CV_64F);
         pano = pano / 255.0 * (global_max - global_min) + global_min;
 
-        // 结果图像的尺寸，应为 正方形 且为 64 的倍数
-        int target_size = std::max(pano.rows, pano.cols);
-        if (target_size % 64 != 0) target_size += 64 - (target_size % 64);
+        SpmHeightMap<double> stitching_image = toOutputImage(pano, global_min);
 
-        // 初始化
-        std::vector<std::vector<double>> stitching_image(target_size, std::vector<double>(target_size, global_min));
-        for (int r = 0; r < pano.rows; ++r) {
-            for (int c = 0; c < pano.cols; ++c) {
-                stitching_image[r][c] = pano.at<double>(r, c);
-            }
+        std::cout << "stitchingImage() [Info]: Stitching successful. Output size: "
+                  << stitching_image.cols() << "x" << stitching_image.rows() << std::endl;
+
+        if (status) *status = 0;
+        return stitching_image;
+    }
+
+    /**
+     * @brief 由载物台坐标预测位置、互相关配准的平移拼接，见 SpmGridStitcher
+     */
+    SpmHeightMap<double> stitchingImageGrid(std::vector<SpmReader> &spm_reader_list,
+                                            std::vector<cv::Mat> &image_f1_list, int *status = nullptr) {
+        if (image_f1_list.empty() || spm_reader_list.size() != image_f1_list.size()) {
+            std::cout << "stitchingImageGrid() [Error]: " << image_f1_list.size() << " images, "
+                      << spm_reader_list.size() << " SPM readers." << std::endl;
+            if (status) *status = -1;
+            return {};
         }
 
-        std::cout << "stitchingImage() [Info]: Stitching successful. Output size: "
-                  << target_size << "x" << target_size << std::endl;
+        std::vector<cv::Point2d> predicted_list;
+        if (!SpmGridStitcher::predictPlacement(spm_reader_list, predicted_list, m_grid_params.stage_y_up)) {
+            if (status) *status = -7;
+            return {};
+        }
+
+        SpmGridStitcher::Params grid_params = m_grid_params;
+        if (grid_params.max_workers <= 0) grid_params.max_workers = m_max_workers;
+
+        SpmHeightMap<double> canvas;
+        if (!SpmGridStitcher::stitch(image_f1_list, predicted_list, canvas, grid_params)) {
+            if (status) *status = -8;
+            return {};
+        }
+
+        double min_value;
+        cv::Mat canvas_image = SpmAlgorithm::wrapHeightMap(canvas.view());
+        cv::minMaxLoc(canvas_image, &min_value, nullptr);
+        SpmHeightMap<double> stitching_image = toOutputImage(canvas_image, min_value);
+
+        std::cout << "stitchingImageGrid() [Info]: Stitching successful. Output size: "
+                  << stitching_image.cols() << "x" << stitching_image.rows() << std::endl;
 
         if (status) *status = 0;
         return stitching_image;
     }
 
-    static double calcNewZScale(SpmReader &spm_reader, std::vector<std::vector<double>> &stitching_image_data) {
-        double min_value = stitching_image_data[0][0];
-        double max_value = stitching_image_data[0][0];
-        for (const auto &row : stitching_image_data) {
-            for (double value : row) {
-                if (value < min_value) min_value = value;
-                if (value > max_value) max_value = value;
-            }
+    /**
+     * @brief 拼接结果整块拷贝到输出图像的左上角，输出图像为 正方形 且边长为 64 的倍数，其余部分填充 fill_value
+     */
+    static SpmHeightMap<double> toOutputImage(const cv::Mat &image, double fill_value) {
+        int target_size = std::max(image.rows, image.cols);
+        if (target_size % 64 != 0) target_size += 64 - (target_size % 64);
+
+        SpmHeightMap<double> output_image(target_size, target_size, fill_value);
+        image.copyTo(SpmAlgorithm::wrapHeightMap(output_image.view())(cv::Rect(0, 0, image.cols, image.rows)));
+
+        return output_image;
+    }
+
+    static SpmHeightMap<double> finishStitchingImage(SpmHeightMap<double> stitching_image_data, int stitching_status,
+                                                     cv::Mat *stitched_image) {
+        if (stitching_status != 0) {
+            std::cout << "execStitchingImage() [Error]: Image stitching failed! Status code: "
+                      << stitching_status << std::endl;
+            return {};
+        }
+
+        if (stitched_image) {
+            cv::normalize(SpmAlgorithm::wrapHeightMap(stitching_image_data.view()), *stitched_image,
+                          255, 0, cv::NORM_MINMAX, CV_8U);
         }
 
+        return stitching_image_data;
+    }
+
+    static double calcNewZScale(SpmReader &spm_reader, const SpmHeightMap<double> &stitching_image_data) {
+        double min_value, max_value;
+        cv::minMaxLoc(SpmAlgorithm::wrapHeightMap(stitching_image_data.view()), &min_value, &max_value);
+
         double max_possible_value;
         if (spm_reader.getImageSingle().getBytesPerPixel() == 2)
             max_possible_value = std::numeric_limits<uint16_t>::max();
@@ -211,36 +469,35 @@ private:
     }
 
     static std::vector<char>
-    calcRawDataToByteData(SpmReader &spm_reader, std::vector<std::vector<double>> &stitching_image_data,
+    calcRawDataToByteData(SpmReader &spm_reader, const SpmHeightMap<double> &stitching_image_data,
                           double z_scale) {
-        double z_scale_sens = spm_reader.getImageSingle().getZScaleSens();
-        int power_num = 8 * spm_reader.getImageSingle().getBytesPerPixel();
-
-        std::vector<char> byte_data;
         if (spm_reader.getImageSingle().getBytesPerPixel() == 2) {
-            std::vector<short> raw_data;
-
-            std::reverse(stitching_image_data.begin(), stitching_image_data.end());
-            for (auto &r : stitching_image_data) {
-                for (double c : r) {
-                    raw_data.emplace_back(static_cast<short>(c / z_scale_sens / z_scale * std::pow(2, power_num)));
-                }
-            }
-
-            byte_data.assign(reinterpret_cast<const char *>(raw_data.data()),
-                             reinterpret_cast<const char *>(raw_data.data() + raw_data.size()));
+            return calcRawDataToByteData<short>(spm_reader, stitching_image_data, z_scale);
         } else {  // spm_reader.getImageSingle().getBytesPerPixel() == 4
-            std::vector<int> raw_data;
+            return calcRawDataToByteData<int>(spm_reader, stitching_image_data, z_scale);
+        }
+    }
 
-            std::reverse(stitching_image_data.begin(), stitching_image_data.end());
-            for (auto &r : stitching_image_data) {
-                for (double c : r) {
-                    raw_data.emplace_back(static_cast<int>(c / z_scale_sens / z_scale * std::pow(2, power_num)));
-                }
+    template<typename T>
+    static std::vector<char>
+    calcRawDataToByteData(SpmReader &spm_reader, const SpmHeightMap<double> &stitching_image_data,
+                          double z_scale) {
+        double z_scale_sens = spm_reader.getImageSingle().getZScaleSens();
+        int power_num = 8 * spm_reader.getImageSingle().getBytesPerPixel();
+        double raw_scale = std::pow(2, power_num);
+
+        const int rows = stitching_image_data.rows();
+        const int cols = stitching_image_data.cols();
+
+        // 行顺序反转后直接写入 byte data
+        std::vector<char> byte_data((size_t) rows * cols * sizeof(T));
+        T *raw_data = reinterpret_cast<T *>(byte_data.data());
+        for (int r = 0; r < rows; ++r) {
+            const double *line_data = stitching_image_data.rowPtr(rows - 1 - r);
+            T *raw_line = raw_data + (size_t) r * cols;
+            for (int c = 0; c < cols; ++c) {
+                raw_line[c] = static_cast<T>(line_data[c] / z_scale_sens / z_scale * raw_scale);
             }
-
-            byte_data.assign(reinterpret_cast<const char *>(raw_data.data()),
-                             reinterpret_cast<const char *>(raw_data.data() + raw_data.size()));
         }
 
         return byte_data;
@@ -250,131 +507,98 @@ private:
                               const std::string &image_type,
                               int new_data_length, double new_z_scale, int new_samps_line, int new_number_of_lines,
                               int new_scan_size) {
-        // calc index
-#ifdef _MSC_VER
-        FILE *spm_file_index = nullptr;
-        errno_t err_index = _wfopen_s(&spm_file_index, string2wstring(tmpl_spm_path).c_str(), L"r");
-#else
-        FILE *spm_file_index = _wfopen(string2wstring(m_spm_path).c_str(), L"r");
-#endif
-
-        if (!spm_file_index) {
+        SpmFile spm_file;
+        if (!spm_file.open(SpmFile::fromUtf8(tmpl_spm_path))) {
             std::cout << "Failed to open SPM file: " << tmpl_spm_path << std::endl;
-            return {};
+            return false;
         }
 
-        int image_index = 0;
-        std::string text_index, line_index;
-        std::wstring line_w_index;
-        wchar_t buffer_index[1024];
-        while (fgetws(buffer_index, sizeof(buffer_index) / sizeof(buffer_index[0]), spm_file_index)) {
-            line_w_index = buffer_index;
-            line_index = wstring2string(line_w_index);
-            line_index.assign(line_index.begin(), line_index.end() - 1);  // 去除 '\n'
-            if (line_index.substr(0, 2) == "\\*") {
-                if (line_index == "\\*File list end") {  // end, last Image list
-                    break;
-                }
-                if (line_index == "\\*Ciao image list") {
-                    if (image_index == 0) {  // Head list
-                        image_index++;
-                    } else {  // Image list
-                        std::string this_image_type = getStringFromTextByRegex(R"(\@2:Image Data: S \[.*?\] \"(.*?)\")",
-                                                                               text_index);
-                        if (this_image_type == image_type) {  // 是需要的图像
-                            break;
-                        }
-                        image_index++;
-                    }
-                    text_index.clear();
-                }
-            }
-            text_index.append(line_index);
-            text_index.append("\n");
+        std::string header_buffer;
+        SpmHeaderScanner::readHeaderBytes(spm_file, header_buffer);
+        spm_file.close();
+
+        SpmHeaderScanner header_scanner;
+        if (!header_scanner.scan(header_buffer)) {
+            std::cout << "SpmStitching::buildOutputSpmHeader() [Error]: Invalid SPM file header: " << tmpl_spm_path
+                      << std::endl;
+            return false;
         }
 
-        fclose(spm_file_index);
+        // calc index
+        auto &image_list = header_scanner.imageList();
+        auto image_it = std::find_if(image_list.begin(), image_list.end(),
+                                     [&](const SpmHeaderScanner::Section &section) {
+                                         return section.image_type == image_type;  // 是需要的图像
+                                     });
+        if (image_it == image_list.end()) {
+            std::cout << "SpmStitching::buildOutputSpmHeader() [Error]: Image type not found: " << image_type
+                      << std::endl;
+            return false;
+        }
 
-// write
-#ifdef _MSC_VER
-        FILE *spm_file = nullptr;
-        errno_t err = _wfopen_s(&spm_file, string2wstring(tmpl_spm_path).c_str(), L"r");
-#else
-        FILE *spm_file = _wfopen(string2wstring(tmpl_spm_path).c_str(), L"r");
-#endif
+        const SpmHeaderScanner::Section &head = header_scanner.head();
+        m_data_length = 0;
+        SpmHeaderIndex(head.text).getInt("Data length", m_data_length);
 
-        if (!spm_file) {
-            std::cout << "Failed to open SPM file: " << tmpl_spm_path << std::endl;
+        // write, 未修改的行按原样（包括行尾）写出
+        std::ofstream out_spm_file(SpmFile::fromUtf8(output_spm_path), std::ios::binary | std::ios::trunc);
+        if (!out_spm_file.is_open()) {
+            std::cout << "Failed to open output file: " << output_spm_path << std::endl;
             return false;
         }
 
-        std::wofstream out_spm_file(output_spm_path);
-
-        std::string text, line;
-        std::wstring text_w, line_w;
-        wchar_t buffer[1024];
-        int image_num = 0;
-        while (fgetws(buffer, sizeof(buffer) / sizeof(buffer[0]), spm_file)) {
-            line_w = buffer;
-            line = wstring2string(line_w);
-
-            if (line == "\\*Ciao image list\n" || line == "\\*File list end\n") {
-                if (image_num == 0) {  // head
-                    out_spm_file << text_w;
-                    m_data_length = getIntFromTextByRegex(R"(\Data length: (\d+))", text);
-                } else if (image_num == image_index) {  // image
-                    out_spm_file << text_w;
-                    break;
+        std::string_view first_line = head.text.substr(0, head.text.find('\n') + 1);
+        bool is_crlf = first_line.size() >= 2 && first_line[first_line.size() - 2] == '\r';
+        std::string_view line_end_str = is_crlf ? "\r\n" : "\n";
+
+        auto write_section = [&](std::string_view section_text, bool is_image) {
+            SpmHeaderScanner::forEachLine(section_text, [&](std::string_view line_view,
+                                                            std::string_view line_with_eol) {
+                std::string line;
+                if (is_image && line_view.substr(0, 13) == "\\Data length:") {
+                    line = line_view;
+                    replaceIntFromTextByRegex(R"(\Data length: (\d+))", line, new_data_length);
+                } else if (line_view.substr(0, 32) == "\\@2:Z scale: V [Sens. ZsensSens]") {
+                    line = line_view;
+                    replaceDoubleFromTextByRegex(R"(\@2:Z scale: V \[.*?\] .*? (\d+\.\d+) .*)", line, new_z_scale);
+                } else if (is_image && line_view.substr(0, 12) == "\\Samps/line:") {
+                    line = line_view;
+                    replaceIntFromTextByRegex(R"(\Samps/line: (\d+))", line, new_samps_line);
+                } else if (is_image && line_view.substr(0, 17) == "\\Number of lines:") {
+                    line = line_view;
+                    replaceIntFromTextByRegex(R"(\Number of lines: (\d+))", line, new_number_of_lines);
+                } else if (is_image && line_view.substr(0, 18) == "\\Valid data len X:") {
+                    line = line_view;
+                    replaceIntFromTextByRegex(R"(\Valid data len X: (\d+))", line, new_samps_line);
+                } else if (is_image && line_view.substr(0, 18) == "\\Valid data len Y:") {
+                    line = line_view;
+                    replaceIntFromTextByRegex(R"(\Valid data len Y: (\d+))", line, new_number_of_lines);
+                } else if (line_view.substr(0, 11) == "\\Scan Size:") {
+                    line = line_view;
+                    replaceLengthNMFromText(line, new_scan_size);
+                } else {
+                    out_spm_file.write(line_with_eol.data(), (std::streamsize) line_with_eol.size());
+                    return;
                 }
 
-                image_num += 1;
-                text.clear();
-                text_w.clear();
-            }
-
-            if (image_num == image_index && line.substr(0, 13) == "\\Data length:") {
-                replaceIntFromTextByRegex(R"(\Data length: (\d+))", line, new_data_length);
-                line_w = string2wstring(line);
-            }
-            if (line.substr(0, 32) == "\\@2:Z scale: V [Sens. ZsensSens]") {
-                replaceDoubleFromTextByRegex(R"(\@2:Z scale: V \[.*?\] .*? (\d+\.\d+) .*)", line, new_z_scale);
-                line_w = string2wstring(line);
-            }
-            if (image_num == image_index && line.substr(0, 12) == "\\Samps/line:") {
-                replaceIntFromTextByRegex(R"(\Samps/line: (\d+))", line, new_samps_line);
-                line_w = string2wstring(line);
-            }
-            if (image_num == image_index && line.substr(0, 17) == "\\Number of lines:") {
-                replaceIntFromTextByRegex(R"(\Number of lines: (\d+))", line, new_number_of_lines);
-                line_w = string2wstring(line);
-            }
-            if (image_num == image_index && line.substr(0, 18) == "\\Valid data len X:") {
-                replaceIntFromTextByRegex(R"(\Valid data len X: (\d+))", line, new_samps_line);
-                line_w = string2wstring(line);
-            }
-            if (image_num == image_index && line.substr(0, 18) == "\\Valid data len Y:") {
-                replaceIntFromTextByRegex(R"(\Valid data len Y: (\d+))", line, new_number_of_lines);
-                line_w = string2wstring(line);
-            }
-            if (line.substr(0, 11) == "\\Scan Size:") {
-                replaceIntFromTextByRegex(R"(\Scan Size: (\d+) nm)", line, new_scan_size);
-                line_w = string2wstring(line);
-            }
+                out_spm_file.write(line.data(), (std::streamsize) line.size());
+                out_spm_file.write(line_with_eol.data() + line_view.size(),
+                                   (std::streamsize) (line_with_eol.size() - line_view.size()));
+            });
+        };
 
-            text.append(line);
-            text_w.append(line_w);
-        }
-        out_spm_file << L"\\*File list end\n";
+        write_section(head.text, false);
+        write_section(image_it->text, true);
+        out_spm_file << SpmHeaderScanner::file_list_end_str << line_end_str;
 
-        fclose(spm_file);
         out_spm_file.close();
 
-        return true;
+        return out_spm_file.good();
     }
 
     bool fillNullToHeader(const std::string &output_spm_path) const {
         // 获取输出文件的占用空间
-        std::ifstream output_file(output_spm_path, std::ios::binary | std::ios::ate);
+        std::ifstream output_file(SpmFile::fromUtf8(output_spm_path), std::ios::binary | std::ios::ate);
         if (!output_file.is_open()) {
             std::cout << "Failed to open output file: " << output_spm_path << std::endl;
             return false;
@@ -385,7 +609,7 @@ private:
 
         // 计算需要填充的字节数
         if (current_size < m_data_length) {
-            std::ofstream output_file_append(output_spm_path, std::ios::binary | std::ios::app);
+            std::ofstream output_file_append(SpmFile::fromUtf8(output_spm_path), std::ios::binary | std::ios::app);
             if (!output_file_append.is_open()) {
                 std::cerr << "Failed to open output file: " << output_spm_path << std::endl;
                 return false;
@@ -397,10 +621,8 @@ private:
 
             // 使用 '0x00' 填充直到达到所需大小
             std::streamsize bytes_to_append = m_data_length - current_size - 1;
-            char zero_byte = '\0';
-            for (std::streamsize i = 0; i < bytes_to_append; ++i) {
-                output_file_append.write(&zero_byte, sizeof(zero_byte));
-            }
+            std::vector<char> zero_bytes((size_t) std::max<std::streamsize>(bytes_to_append, 0), '\0');
+            output_file_append.write(zero_bytes.data(), (std::streamsize) zero_bytes.size());
 
             output_file_append.close();
         }
@@ -409,15 +631,13 @@ private:
     }
 
     static bool fillStitchedImageData(const std::string &output_spm_path, std::vector<char> &byte_data) {
-        std::ofstream output_file_append(output_spm_path, std::ios::binary | std::ios::app);
+        std::ofstream output_file_append(SpmFile::fromUtf8(output_spm_path), std::ios::binary | std::ios::app);
         if (!output_file_append.is_open()) {
             std::cerr << "Failed to open output file: " << output_spm_path << std::endl;
             return false;
         }
 
-        for (char a_byte : byte_data) {
-            output_file_append.write(&a_byte, sizeof(a_byte));
-        }
+        output_file_append.write(byte_data.data(), (std::streamsize) byte_data.size());
 
         output_file_append.close();
 
@@ -426,6 +646,17 @@ private:
 
 private:
     int m_data_length{};
+    SpmImage::DataPrecision m_data_precision = SpmImage::DataPrecision::Float64;
+    SpmImage::RawDataRetention m_raw_data_retention = SpmImage::RawDataRetention::Drop;
+    SpmFlatten::Mode m_flatten_mode = SpmFlatten::Mode::Line;
+    int m_flatten_order = 1;
+    SpmFlatten::Robust m_flatten_robust;
+    int m_max_workers = 0;
+    StitchingMethod m_stitching_method = StitchingMethod::Grid;
+    SpmGridStitcher::Params m_grid_params;
+    std::shared_ptr<SpmTileCache> m_tile_cache;
+    int m_prefetch_depth = 0;
+    unsigned long long m_prefetch_max_bytes = SpmPrefetchReader::default_max_bytes;
 };
 
 
@@ -0,0 +1,334 @@
+#ifndef SPM_TILE_CACHE_HPP
+#define SPM_TILE_CACHE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "spm_file.hpp"
+#include "spm_height_map.hpp"
+
+
+/**
+ * @brief 图块缓存的键: 文件路径 + 文件大小 + 修改时间 + 通道 + 处理参数
+ */
+struct SpmTileKey {
+    std::string spm_path;
+    unsigned long long file_size{};
+    long long file_mtime{};
+    std::string image_type;
+    std::string processing;  // 处理参数，如 "decoded/f64"、"flatten_first/f32"
+
+    std::string toString() const {
+        return spm_path + "|" + std::to_string(file_size) + "|" + std::to_string(file_mtime) + "|" +
+               image_type + "|" + processing;
+    }
+};
+
+
+/**
+ * @brief 持久化的已解码图块缓存
+ *
+ * 每个图块保存为缓存目录中的一个 .spmtile 文件（文件名为键的哈希值），格式如下:
+ *   [0, 64)              Header
+ *   [64, payload_offset) 完整的键字符串，用于校验哈希冲突
+ *   [payload_offset, ..) rows x cols 的行主序数据，payload_offset 按 64 字节对齐，可直接内存映射
+ *
+ * 缓存总大小超过上限时按最近使用时间（命中时会更新文件修改时间）淘汰最久未使用的图块。
+ * 同一实例可被多个线程同时使用，多个进程也可共享同一缓存目录: 写入时先写入以进程 id 与线程区分的临时文件再重命名，
+ * 进程异常退出遗留的临时文件超过 stale_temp_age 未修改时，在构造、evict() 与 clear() 时删除。
+ */
+class SpmTileCache {
+public:
+    static constexpr unsigned long long default_max_bytes = 2ULL * 1024 * 1024 * 1024;  // 2 GB
+
+    explicit SpmTileCache(const std::string &cache_dir, unsigned long long max_bytes = default_max_bytes)
+            : m_cache_dir(SpmFile::fromUtf8(cache_dir)), m_max_bytes(max_bytes) {
+        std::error_code ec;
+        std::filesystem::create_directories(m_cache_dir, ec);
+        m_total_bytes = scanTotalBytes();
+    }
+
+    ~SpmTileCache() = default;
+
+public:
+    /**
+     * @brief 根据文件当前的大小与修改时间生成缓存键
+     *
+     * @return false if the file does not exist
+     */
+    static bool makeKey(const std::string &spm_path, const std::string &image_type, const std::string &processing,
+                        SpmTileKey &key) {
+        std::error_code ec;
+        std::filesystem::path path = SpmFile::fromUtf8(spm_path);
+
+        auto file_size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        auto file_mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) return false;
+
+        key.spm_path = std::filesystem::absolute(path, ec).u8string();
+        if (ec) key.spm_path = spm_path;
+        key.file_size = file_size;
+        key.file_mtime = (long long) file_mtime.time_since_epoch().count();
+        key.image_type = image_type;
+        key.processing = processing;
+        return true;
+    }
+
+    /**
+     * @brief 缓存中是否存在该键对应的图块文件（不校验内容，load() 仍可能失败）
+     */
+    bool contains(const SpmTileKey &key) const {
+        std::error_code ec;
+        return std::filesystem::exists(entryPath(key.toString()), ec);
+    }
+
+    template<typename T>
+    bool load(const SpmTileKey &key, SpmHeightMap<T> &height_map) {
+        std::string key_str = key.toString();
+        std::filesystem::path entry_path = entryPath(key_str);
+
+        SpmMappedFile entry_file;
+        if (!entry_file.open(entry_path)) return false;
+
+        Header header{};
+        if (entry_file.size() < sizeof(Header)) return false;
+        std::memcpy(&header, entry_file.data(), sizeof(Header));
+
+        if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 || header.version != version ||
+            header.element_size != sizeof(T) || header.rows <= 0 || header.cols <= 0 ||
+            header.key_size != key_str.size() ||
+            header.payload_size != (uint64_t) header.rows * header.cols * sizeof(T) ||
+            !entry_file.contains(sizeof(Header), header.key_size) ||
+            !entry_file.contains(header.payload_offset, header.payload_size)) {
+            return false;
+        }
+
+        if (std::memcmp(entry_file.data() + sizeof(Header), key_str.data(), key_str.size()) != 0) {
+            return false;  // 哈希冲突
+        }
+
+        height_map.create(header.rows, header.cols);
+        std::memcpy(height_map.data(), entry_file.data() + header.payload_offset, header.payload_size);
+        entry_file.close();
+
+        // 更新修改时间作为最近使用时间
+        std::error_code ec;
+        std::filesystem::last_write_time(entry_path, std::filesystem::file_time_type::clock::now(), ec);
+
+        return true;
+    }
+
+    template<typename T>
+    bool store(const SpmTileKey &key, const SpmHeightMap<T> &height_map) {
+        if (height_map.empty()) return false;
+
+        std::string key_str = key.toString();
+        std::filesystem::path entry_path = entryPath(key_str);
+
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.element_size = sizeof(T);
+        header.rows = height_map.rows();
+        header.cols = height_map.cols();
+        header.key_size = (uint32_t) key_str.size();
+        header.payload_offset = alignUp(sizeof(Header) + key_str.size(), payload_alignment);
+        header.payload_size = (uint64_t) height_map.rows() * height_map.cols() * sizeof(T);
+
+        // 先写入临时文件再重命名，避免其他线程 / 进程读到不完整的图块
+        std::filesystem::path temp_path = entry_path;
+        temp_path += temp_suffix + std::to_string(processId()) + "-" +
+                     std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream entry_file(temp_path, std::ios::binary | std::ios::trunc);
+            if (!entry_file.is_open()) {
+                std::cout << "SpmTileCache::store() [Error]: Failed to create cache file: " << temp_path.u8string()
+                          << std::endl;
+                return false;
+            }
+
+            std::vector<char> padding(header.payload_offset - sizeof(Header) - key_str.size(), '\0');
+            entry_file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+            entry_file.write(key_str.data(), (std::streamsize) key_str.size());
+            entry_file.write(padding.data(), (std::streamsize) padding.size());
+            for (int r = 0; r < height_map.rows(); ++r) {
+                entry_file.write(reinterpret_cast<const char *>(height_map.rowPtr(r)),
+                                 (std::streamsize) (height_map.cols() * sizeof(T)));
+            }
+
+            if (!entry_file.good()) {
+                entry_file.close();
+                std::error_code ec;
+                std::filesystem::remove(temp_path, ec);
+                return false;
+            }
+        }
+
+        unsigned long long entry_bytes = header.payload_offset + header.payload_size;
+        bool need_evict;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // 覆盖已有图块时扣除被替换文件的大小
+            std::error_code ec;
+            unsigned long long replaced_bytes = std::filesystem::file_size(entry_path, ec);
+            if (ec) replaced_bytes = 0;
+
+            std::filesystem::rename(temp_path, entry_path, ec);
+            if (ec) {
+                std::filesystem::remove(temp_path, ec);
+                return false;
+            }
+
+            m_total_bytes -= std::min(replaced_bytes, m_total_bytes);
+            m_total_bytes += entry_bytes;
+            need_evict = m_total_bytes > m_max_bytes;
+        }
+        if (need_evict) evict();
+
+        return true;
+    }
+
+    /**
+     * @brief 淘汰最久未使用的图块，直到缓存总大小不超过上限的 90%
+     */
+    void evict() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::directory_entry>> entry_list;
+        unsigned long long total_bytes = 0;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(m_cache_dir, ec)) {
+            if (entry.path().extension().string() != entry_extension) {
+                removeStaleTemp(entry);
+                continue;
+            }
+            total_bytes += entry.file_size(ec);
+            entry_list.emplace_back(entry.last_write_time(ec), entry);
+        }
+
+        std::sort(entry_list.begin(), entry_list.end(),
+                  [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        unsigned long long target_bytes = m_max_bytes / 10 * 9;
+        for (auto &entry : entry_list) {
+            if (total_bytes <= target_bytes) break;
+
+            unsigned long long entry_bytes = entry.second.file_size(ec);
+            if (std::filesystem::remove(entry.second.path(), ec)) total_bytes -= entry_bytes;
+        }
+
+        m_total_bytes = total_bytes;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(m_cache_dir, ec)) {
+            if (entry.path().extension().string() == entry_extension) std::filesystem::remove(entry.path(), ec);
+            else removeStaleTemp(entry);
+        }
+        m_total_bytes = 0;
+    }
+
+    std::string getCacheDir() const { return m_cache_dir.u8string(); }
+
+    unsigned long long getMaxBytes() const { return m_max_bytes; }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t element_size;  // 4: float, 8: double
+        int32_t rows;
+        int32_t cols;
+        uint32_t key_size;
+        uint32_t payload_offset;
+        uint64_t payload_size;
+        char reserved[24];
+    };
+    static_assert(sizeof(Header) == 64, "SpmTileCache header must be 64 bytes");
+
+    std::filesystem::path entryPath(const std::string &key_str) const {
+        // FNV-1a 64
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char ch : key_str) {
+            hash ^= ch;
+            hash *= 1099511628211ULL;
+        }
+
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long) hash);
+        return m_cache_dir / (std::string(name) + entry_extension);
+    }
+
+    unsigned long long scanTotalBytes() const {
+        unsigned long long total_bytes = 0;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(m_cache_dir, ec)) {
+            if (entry.path().extension().string() == entry_extension) total_bytes += entry.file_size(ec);
+            else removeStaleTemp(entry);
+        }
+        return total_bytes;
+    }
+
+    // 删除超过 stale_temp_age 未修改的临时文件（store() 写入过程中进程退出时遗留），正在写入的临时文件不受影响
+    static void removeStaleTemp(const std::filesystem::directory_entry &entry) {
+        if (entry.path().filename().string().find(std::string(entry_extension) + temp_suffix) == std::string::npos) {
+            return;
+        }
+
+        std::error_code ec;
+        auto write_time = entry.last_write_time(ec);
+        if (ec || std::filesystem::file_time_type::clock::now() - write_time < stale_temp_age) return;
+
+        std::filesystem::remove(entry.path(), ec);
+    }
+
+    static unsigned long processId() {
+#ifdef _WIN32
+        return (unsigned long) GetCurrentProcessId();
+#else
+        return (unsigned long) getpid();
+#endif
+    }
+
+    static uint32_t alignUp(size_t value, size_t alignment) {
+        return (uint32_t) ((value + alignment - 1) / alignment * alignment);
+    }
+
+private:
+    static constexpr char magic[8] = {'S', 'P', 'M', 'T', 'I', 'L', 'E', '\0'};
+    static constexpr uint32_t version = 1;
+    static constexpr size_t payload_alignment = 64;
+    static constexpr const char *entry_extension = ".spmtile";
+    static constexpr const char *temp_suffix = ".tmp";
+    static constexpr std::chrono::minutes stale_temp_age{10};
+
+    std::filesystem::path m_cache_dir;
+    unsigned long long m_max_bytes;
+    unsigned long long m_total_bytes = 0;
+    std::mutex m_mutex;
+};
+
+
+#endif //SPM_TILE_CACHE_HPP
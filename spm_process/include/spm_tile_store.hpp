@@ -0,0 +1,538 @@
+#ifndef SPM_TILE_STORE_HPP
+#define SPM_TILE_STORE_HPP
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "opencv2/opencv.hpp"
+
+#include "spm_parallel.hpp"
+
+
+/**
+ * @brief 内存中的压缩图块存储
+ *
+ * 暂不使用的图块（如界面中等待预览 / 保存的拉平图像）以压缩形式保存在内存中，使用时再解压。两种压缩方式:
+ *   Lossless:  浮点数的位模式映射为与数值顺序一致的无符号整数，解压结果与原图逐位相同（包括 NaN / Inf）
+ *   Quantized: 按图块的最小值 / 最大值量化为 16 位整数，最大误差为 (max - min) / 131070，只适合预览
+ * 之后两者相同:
+ *   1. 以 MED 预测器（左、上、左上三个相邻像素，同 LOCO-I）计算预测残差
+ *   2. 残差经 zigzag 映射后按行使用 Rice 编码，每行根据残差均值选择参数 k
+ *
+ * 默认使用 Lossless，避免解压后的图块被误用于保存高度数据。但含噪声的高度图低位接近随机，Lossless 的压缩率只有
+ * 1.15 (CV_64F) ~ 1.3 (CV_32F)，编码也更慢，Quantized 约为 6 (CV_64F) / 3 (CV_32F)，见 tests/spm_tile_store_check.cpp；
+ * 只用于预览的图块（如界面中的拉平图像）应使用 Quantized，保存时由 SpmTileCache 或 SPM 文件重新读取全精度图像。
+ * 压缩与解压均以图块为单位，putAll() / getAll() 在多个线程上并行处理各图块。
+ *
+ * 预先 resize() 后，不同索引可由多个线程同时 put() / get()；resize() / swap() / erase() 等操作需在外部同步。
+ */
+class SpmTileStore {
+public:
+    // 压缩方式
+    enum class Mode {
+        Lossless,  // 无损，解压结果与原图逐位相同
+        Quantized  // 16 位量化后压缩，仅用于预览
+    };
+
+    SpmTileStore() = default;
+
+    explicit SpmTileStore(Mode mode)
+            : m_mode(mode) {}
+
+    ~SpmTileStore() = default;
+
+public:
+    /**
+     * @brief 设置此后 put() / putAll() 使用的压缩方式，已保存的图块不变
+     */
+    void setMode(Mode mode) { m_mode = mode; }
+
+    Mode mode() const { return m_mode; }
+
+    size_t size() const { return m_tile_list.size(); }
+
+    bool empty() const { return m_tile_list.empty(); }
+
+    void resize(size_t count) { m_tile_list.resize(count); }
+
+    void clear() {
+        m_tile_list.clear();
+        m_tile_list.shrink_to_fit();
+    }
+
+    /**
+     * @brief 压缩并保存第 index 个图块，index 超出范围时自动扩展
+     *
+     * @param index The tile index.
+     * @param image The single channel CV_32F or CV_64F image.
+     * @return true if successful
+     */
+    bool put(size_t index, const cv::Mat &image) {
+        if (index >= m_tile_list.size()) m_tile_list.resize(index + 1);
+
+        if (image.empty() || image.channels() != 1 || (image.depth() != CV_32F && image.depth() != CV_64F)) {
+            std::cout << "SpmTileStore::put() [Error]: Image must be single channel CV_32F or CV_64F." << std::endl;
+            m_tile_list[index] = Tile();
+            return false;
+        }
+
+        Tile tile;
+        if (m_mode == Mode::Lossless) {
+            if (image.depth() == CV_32F) {
+                encodeTileLossless<float>(image, tile);
+            } else {
+                encodeTileLossless<double>(image, tile);
+            }
+        } else if (image.depth() == CV_32F) {
+            encodeTile<float>(image, tile);
+        } else {
+            encodeTile<double>(image, tile);
+        }
+        m_tile_list[index] = std::move(tile);
+
+        return true;
+    }
+
+    /**
+     * @brief 并行压缩全部图块，替换原有内容
+     *
+     * @param image_list The images.
+     * @param max_workers The maximum number of worker threads, <= 0 for hardware concurrency.
+     * @return true if all images are stored
+     */
+    bool putAll(const std::vector<cv::Mat> &image_list, int max_workers = 0) {
+        m_tile_list.assign(image_list.size(), Tile());
+
+        std::vector<char> status_list(image_list.size(), 0);
+        SpmParallel::forEachIndex(image_list.size(), max_workers, [&](size_t i) {
+            status_list[i] = put(i, image_list[i]);
+        });
+
+        return std::all_of(status_list.begin(), status_list.end(), [](char status) { return status != 0; });
+    }
+
+    /**
+     * @brief 解压第 index 个图块
+     *
+     * @param index The tile index.
+     * @return the image with the original type, empty if not stored
+     */
+    cv::Mat get(size_t index) const {
+        if (index >= m_tile_list.size() || m_tile_list[index].rows <= 0) return {};
+
+        const Tile &tile = m_tile_list[index];
+        cv::Mat image(tile.rows, tile.cols, tile.type);
+        if (tile.lossless) {
+            if (tile.type == CV_32FC1) {
+                decodeTileLossless<float>(tile, image);
+            } else {
+                decodeTileLossless<double>(tile, image);
+            }
+        } else if (tile.type == CV_32FC1) {
+            decodeTile<float>(tile, image);
+        } else {
+            decodeTile<double>(tile, image);
+        }
+
+        return image;
+    }
+
+    /**
+     * @brief 并行解压全部图块
+     *
+     * @param max_workers The maximum number of worker threads, <= 0 for hardware concurrency.
+     * @return the images in index order
+     */
+    std::vector<cv::Mat> getAll(int max_workers = 0) const {
+        std::vector<cv::Mat> image_list(m_tile_list.size());
+        SpmParallel::forEachIndex(m_tile_list.size(), max_workers, [&](size_t i) {
+            image_list[i] = get(i);
+        });
+
+        return image_list;
+    }
+
+    void swap(size_t index_a, size_t index_b) {
+        std::swap(m_tile_list[index_a], m_tile_list[index_b]);
+    }
+
+    void erase(size_t index) {
+        m_tile_list.erase(m_tile_list.begin() + (std::ptrdiff_t) index);
+    }
+
+    // 压缩后占用的字节数
+    size_t compressedBytes() const {
+        size_t bytes = 0;
+        for (auto &tile : m_tile_list) bytes += tile.bitstream.size();
+        return bytes;
+    }
+
+    // 解压后占用的字节数
+    size_t uncompressedBytes() const {
+        size_t bytes = 0;
+        for (auto &tile : m_tile_list) {
+            bytes += (size_t) tile.rows * tile.cols * (tile.type == CV_32FC1 ? sizeof(float) : sizeof(double));
+        }
+        return bytes;
+    }
+
+private:
+    struct Tile {
+        int rows = 0;
+        int cols = 0;
+        int type = CV_64FC1;
+        bool lossless = false;
+        double min_value = 0.0;
+        double step = 0.0;  // 量化步长，value = min_value + q * step，仅用于 Quantized
+        std::vector<uint8_t> bitstream;
+    };
+
+    // 与浮点数等宽的无符号整数
+    template<typename T>
+    using OrderedBits = std::conditional_t<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>;
+
+    static constexpr int quant_bits = 16;
+    static constexpr uint32_t quant_max = (1u << quant_bits) - 1;
+    static constexpr int residual_bits = quant_bits + 1;  // zigzag 映射后的残差位数
+    static constexpr int k_bits = 5;
+    static constexpr uint32_t unary_limit = 24;  // 商达到该值时改为直接写入残差
+    static constexpr int lossless_k_bits = 6;  // Lossless 的残差最多 64 位
+
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint8_t> &out)
+                : m_out(out) {}
+
+        // bits <= 56
+        void put(uint64_t value, int bits) {
+            m_acc = (m_acc << bits) | value;
+            m_count += bits;
+            while (m_count >= 8) {
+                m_count -= 8;
+                m_out.push_back((uint8_t) (m_acc >> m_count));
+            }
+            m_acc &= (1ULL << m_count) - 1;
+        }
+
+        // bits <= 64
+        void put64(uint64_t value, int bits) {
+            if (bits > 32) {
+                put(value >> 32, bits - 32);
+                bits = 32;
+            }
+            put(value & 0xFFFFFFFFULL, bits);
+        }
+
+        void flush() {
+            if (m_count > 0) put(0, 8 - m_count);
+        }
+
+    private:
+        std::vector<uint8_t> &m_out;
+        uint64_t m_acc = 0;
+        int m_count = 0;
+    };
+
+    class BitReader {
+    public:
+        BitReader(const uint8_t *data, size_t size)
+                : m_data(data), m_end(data + size) {}
+
+        // bits <= 32
+        uint32_t get(int bits) {
+            if (m_count < bits) refill();
+            m_count -= bits;
+            return (uint32_t) ((m_acc >> m_count) & ((1ULL << bits) - 1));
+        }
+
+        // bits <= 64
+        uint64_t get64(int bits) {
+            if (bits <= 32) return get(bits);
+
+            uint64_t high = get(bits - 32);
+            return (high << 32) | get(32);
+        }
+
+        // 连续的 1 的个数（不超过 limit），并跳过其后的 0
+        uint32_t getUnary(uint32_t limit) {
+            if (m_count < (int) limit + 1) refill();
+            uint64_t window = ~(m_acc << (64 - m_count)) | (1ULL << (63 - limit));  // 对齐到最高位，取反后找第一个 1
+            uint32_t q = countLeadingZeros(window);
+            m_count -= (int) q + (q < limit ? 1 : 0);
+            return q;
+        }
+
+    private:
+        void refill() {
+            while (m_count <= 56) {
+                m_acc = (m_acc << 8) | (m_data < m_end ? *m_data++ : 0);
+                m_count += 8;
+            }
+        }
+
+        const uint8_t *m_data;
+        const uint8_t *m_end;
+        uint64_t m_acc = 0;
+        int m_count = 0;
+    };
+
+    // window != 0
+    static uint32_t countLeadingZeros(uint64_t window) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanReverse64(&index, window);
+        return 63 - (uint32_t) index;
+#elif defined(__GNUC__)
+        return (uint32_t) __builtin_clzll(window);
+#else
+        uint32_t count = 0;
+        while (!(window >> 63)) {
+            window <<= 1;
+            ++count;
+        }
+        return count;
+#endif
+    }
+
+    // MED 预测器（a 左, b 上, c 左上），等价于 a, b, a + b - c 三者的中位数，写成无分支形式
+    static int predict(int a, int b, int c) {
+        return std::max(std::min(a, b), std::min(std::max(a, b), a + b - c));
+    }
+
+    // 第 r 行第 c 列的预测值，首行 / 首列只使用已有的相邻像素
+    static int predictAt(const uint16_t *line, const uint16_t *prev_line, int c) {
+        if (!prev_line) return c > 0 ? line[c - 1] : 0;
+        if (c == 0) return prev_line[0];
+        return predict(line[c - 1], prev_line[c], prev_line[c - 1]);
+    }
+
+    static uint32_t zigzag(int value) {
+        return value >= 0 ? (uint32_t) value << 1 : ((uint32_t) (-value) << 1) - 1;
+    }
+
+    static int unzigzag(uint32_t value) {
+        return (value & 1) ? -(int) ((value + 1) >> 1) : (int) (value >> 1);
+    }
+
+    // 浮点数位模式到无符号整数的保序映射: 正数置符号位，负数按位取反，数值相近的像素映射后也相近
+    template<typename U>
+    static U toOrdered(U bits) {
+        constexpr U sign_bit = (U) 1 << (sizeof(U) * 8 - 1);
+        return (bits & sign_bit) ? (U) ~bits : (U) (bits | sign_bit);
+    }
+
+    template<typename U>
+    static U fromOrdered(U ordered) {
+        constexpr U sign_bit = (U) 1 << (sizeof(U) * 8 - 1);
+        return (ordered & sign_bit) ? (U) (ordered & ~sign_bit) : (U) ~ordered;
+    }
+
+    // 无符号整数上的 MED 预测，a + b - c 按模运算，结果总在 [min(a, b), max(a, b)] 内，编解码两端一致
+    template<typename U>
+    static U predictOrderedAt(const U *line, const U *prev_line, int c) {
+        if (!prev_line) return c > 0 ? line[c - 1] : toOrdered<U>(0);  // 首个像素以 +0.0 为预测值
+        if (c == 0) return prev_line[0];
+
+        U a = line[c - 1], b = prev_line[c], cc = prev_line[c - 1];
+        return std::max(std::min(a, b), std::min(std::max(a, b), (U) (a + b - cc)));
+    }
+
+    // 残差按模 2^n 计算，视为有符号数做 zigzag 映射
+    template<typename U>
+    static U zigzagOrdered(U residual) {
+        return (U) (residual << 1) ^ (U) (0 - (residual >> (sizeof(U) * 8 - 1)));
+    }
+
+    template<typename U>
+    static U unzigzagOrdered(U value) {
+        return (U) (value >> 1) ^ (U) (0 - (value & 1));
+    }
+
+    template<typename T>
+    static void encodeTileLossless(const cv::Mat &image, Tile &tile) {
+        using U = OrderedBits<T>;
+        constexpr int value_bits = (int) sizeof(U) * 8;
+
+        tile.rows = image.rows;
+        tile.cols = image.cols;
+        tile.type = image.type();
+        tile.lossless = true;
+
+        std::vector<U> ordered_line(image.cols), prev_ordered_line(image.cols), residual_line(image.cols);
+        tile.bitstream.clear();
+        tile.bitstream.reserve((size_t) image.rows * image.cols * sizeof(T) / 2);
+        BitWriter writer(tile.bitstream);
+
+        for (int r = 0; r < image.rows; ++r) {
+            const T *line = image.ptr<T>(r);
+            for (int c = 0; c < image.cols; ++c) {
+                U bits;
+                std::memcpy(&bits, &line[c], sizeof(U));
+                ordered_line[c] = toOrdered(bits);
+            }
+
+            double residual_sum = 0.0;  // 64 位残差的和可能溢出整数
+            const U *prev_line = r > 0 ? prev_ordered_line.data() : nullptr;
+            for (int c = 0; c < image.cols; ++c) {
+                residual_line[c] = zigzagOrdered<U>(ordered_line[c] - predictOrderedAt(ordered_line.data(), prev_line, c));
+                residual_sum += (double) residual_line[c];
+            }
+
+            int k = 0;
+            while (k < value_bits - 1 && std::ldexp((double) image.cols, k + 1) <= residual_sum) ++k;
+            writer.put((uint32_t) k, lossless_k_bits);
+
+            const U low_mask = ((U) 1 << k) - 1;
+            for (int c = 0; c < image.cols; ++c) {
+                U q = residual_line[c] >> k;
+                if (q < unary_limit) {
+                    writer.put(((1ULL << q) - 1) << 1, (int) q + 1);
+                    writer.put64(residual_line[c] & low_mask, k);
+                } else {
+                    writer.put((1ULL << unary_limit) - 1, (int) unary_limit);
+                    writer.put64(residual_line[c], value_bits);
+                }
+            }
+
+            ordered_line.swap(prev_ordered_line);
+        }
+
+        writer.flush();
+        tile.bitstream.shrink_to_fit();
+    }
+
+    template<typename T>
+    static void decodeTileLossless(const Tile &tile, cv::Mat &image) {
+        using U = OrderedBits<T>;
+        constexpr int value_bits = (int) sizeof(U) * 8;
+
+        std::vector<U> ordered_line(tile.cols), prev_ordered_line(tile.cols);
+        BitReader reader(tile.bitstream.data(), tile.bitstream.size());
+
+        for (int r = 0; r < tile.rows; ++r) {
+            int k = (int) reader.get(lossless_k_bits);
+
+            const U *prev_line = r > 0 ? prev_ordered_line.data() : nullptr;
+            T *line = image.ptr<T>(r);
+            for (int c = 0; c < tile.cols; ++c) {
+                uint32_t q = reader.getUnary(unary_limit);
+                U residual = q < unary_limit ? (U) (((U) q << k) | (U) reader.get64(k)) : (U) reader.get64(value_bits);
+
+                U ordered = (U) (predictOrderedAt(ordered_line.data(), prev_line, c) + unzigzagOrdered(residual));
+                ordered_line[c] = ordered;
+
+                U bits = fromOrdered(ordered);
+                std::memcpy(&line[c], &bits, sizeof(U));
+            }
+
+            ordered_line.swap(prev_ordered_line);
+        }
+    }
+
+    template<typename T>
+    static void encodeTile(const cv::Mat &image, Tile &tile) {
+        tile.rows = image.rows;
+        tile.cols = image.cols;
+        tile.type = image.type();
+
+        // 最小值 / 最大值，不包括非有限值
+        double min_value = HUGE_VAL;
+        double max_value = -HUGE_VAL;
+        for (int r = 0; r < image.rows; ++r) {
+            const T *line = image.ptr<T>(r);
+            for (int c = 0; c < image.cols; ++c) {
+                if (!std::isfinite(line[c])) continue;
+                min_value = std::min(min_value, (double) line[c]);
+                max_value = std::max(max_value, (double) line[c]);
+            }
+        }
+        if (min_value > max_value) min_value = max_value = 0.0;
+
+        tile.min_value = min_value;
+        tile.step = (max_value - min_value) / quant_max;
+        const double inv_step = tile.step > 0.0 ? 1.0 / tile.step : 0.0;
+
+        std::vector<uint16_t> quant_line(image.cols), prev_quant_line(image.cols);
+        std::vector<uint32_t> residual_line(image.cols);
+        tile.bitstream.clear();
+        tile.bitstream.reserve((size_t) image.rows * image.cols);  // 预估约 1 字节 / 像素
+        BitWriter writer(tile.bitstream);
+
+        for (int r = 0; r < image.rows; ++r) {
+            const T *line = image.ptr<T>(r);
+            for (int c = 0; c < image.cols; ++c) {
+                // 四舍五入并截断到 [0, quant_max]，NaN 量化为 0
+                double q = (line[c] - min_value) * inv_step + 0.5;
+                quant_line[c] = q >= 1.0 ? (q < quant_max ? (uint16_t) q : (uint16_t) quant_max) : (uint16_t) 0;
+            }
+
+            uint64_t residual_sum = 0;
+            const uint16_t *prev_line = r > 0 ? prev_quant_line.data() : nullptr;
+            for (int c = 0; c < image.cols; ++c) {
+                residual_line[c] = zigzag(quant_line[c] - predictAt(quant_line.data(), prev_line, c));
+                residual_sum += residual_line[c];
+            }
+
+            // Rice 参数: 2^k 约等于残差均值
+            int k = 0;
+            while (k < residual_bits && ((uint64_t) image.cols << (k + 1)) <= residual_sum) ++k;
+            writer.put((uint32_t) k, k_bits);
+
+            for (int c = 0; c < image.cols; ++c) {
+                uint32_t q = residual_line[c] >> k;
+                // q 个 1 + 一个 0 + 低 k 位; 商过大时写入 unary_limit 个 1 + 完整残差
+                if (q < unary_limit) {
+                    writer.put(((((1ULL << q) - 1) << 1) << k) | (residual_line[c] & ((1u << k) - 1)), (int) q + 1 + k);
+                } else {
+                    writer.put((((1ULL << unary_limit) - 1) << residual_bits) | residual_line[c],
+                               (int) unary_limit + residual_bits);
+                }
+            }
+
+            quant_line.swap(prev_quant_line);
+        }
+
+        writer.flush();
+        tile.bitstream.shrink_to_fit();
+    }
+
+    template<typename T>
+    static void decodeTile(const Tile &tile, cv::Mat &image) {
+        std::vector<uint16_t> quant_line(tile.cols), prev_quant_line(tile.cols);
+        BitReader reader(tile.bitstream.data(), tile.bitstream.size());
+
+        for (int r = 0; r < tile.rows; ++r) {
+            int k = (int) reader.get(k_bits);
+
+            const uint16_t *prev_line = r > 0 ? prev_quant_line.data() : nullptr;
+            T *line = image.ptr<T>(r);
+            for (int c = 0; c < tile.cols; ++c) {
+                uint32_t q = reader.getUnary(unary_limit);
+                uint32_t residual = q < unary_limit ? (q << k) | reader.get(k) : reader.get(residual_bits);
+
+                int value = predictAt(quant_line.data(), prev_line, c) + unzigzag(residual);
+                quant_line[c] = (uint16_t) value;
+                line[c] = (T) (tile.min_value + value * tile.step);
+            }
+
+            quant_line.swap(prev_quant_line);
+        }
+    }
+
+private:
+    Mode m_mode = Mode::Lossless;
+    std::vector<Tile> m_tile_list;
+};
+
+
+#endif //SPM_TILE_STORE_HPP
@@ -0,0 +1,240 @@
+/**
+ * @brief SpmGridStitcher 合成网格检查
+ *
+ * 从一张合成的高度图上按已知位置裁出 4 x 3 个相互重叠的图块（位置带随机抖动，各图块带不同的高度偏移与噪声），
+ * 以带定位误差的预测位置调用 SpmGridStitcher::stitch()，检查:
+ *   1. 求解的图块位置与真实位置完全一致，拼接结果与原高度图只相差一个常数
+ *   2. 有图块与其他图块不连通时返回 false
+ *   3. 画布面积超过 max_canvas_area_ratio 倍图块面积之和时返回 false
+ *   4. 重叠较窄时，朝图块外侧的搜索范围为 重叠宽度 - min_overlap（不超过 search_radius）
+ *
+ * 构建与运行（在仓库根目录下，需 OpenCV）:
+ *   g++ -std=c++17 -O2 -Ispm_process/include -I<opencv include> spm_process/tests/spm_grid_stitch_check.cpp \
+ *       -o spm_grid_stitch_check -l<opencv_core> -l<opencv_imgproc> -lpthread
+ *   ./spm_grid_stitch_check
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "spm_grid_stitcher.hpp"
+
+
+namespace {
+
+int g_fail_count = 0;
+
+void expectTrue(const std::string &name, bool condition) {
+    if (condition) return;
+
+    std::cout << "[FAIL] " << name << std::endl;
+    ++g_fail_count;
+}
+
+/**
+ * @brief 合成高度图: 随机高斯凸起 + 起伏 + 噪声
+ */
+cv::Mat makeSurface(int rows, int cols, unsigned int seed) {
+    std::mt19937 engine(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.02);
+
+    cv::Mat surface = cv::Mat::zeros(rows, cols, CV_64F);
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            surface.at<double>(r, c) = 2.0 * std::sin(c * 0.031) * std::cos(r * 0.023) + noise(engine);
+        }
+    }
+
+    const int bump_count = rows * cols / 400;
+    for (int k = 0; k < bump_count; ++k) {
+        double center_x = uniform(engine) * cols, center_y = uniform(engine) * rows;
+        double radius = 3.0 + 6.0 * uniform(engine), height = 1.0 + 9.0 * uniform(engine);
+        int r0 = std::max(0, (int) (center_y - 3 * radius)), r1 = std::min(rows, (int) (center_y + 3 * radius) + 1);
+        int c0 = std::max(0, (int) (center_x - 3 * radius)), c1 = std::min(cols, (int) (center_x + 3 * radius) + 1);
+        for (int r = r0; r < r1; ++r) {
+            for (int c = c0; c < c1; ++c) {
+                double d2 = (r - center_y) * (r - center_y) + (c - center_x) * (c - center_x);
+                surface.at<double>(r, c) += height * std::exp(-d2 / (2 * radius * radius));
+            }
+        }
+    }
+
+    return surface;
+}
+
+// 从高度图中裁出图块并加上高度偏移与测量噪声
+cv::Mat cropTile(const cv::Mat &surface, cv::Point position, int size, double level, std::mt19937 &engine) {
+    std::normal_distribution<double> noise(0.0, 0.005);
+
+    cv::Mat tile(size, size, CV_64F);
+    for (int r = 0; r < size; ++r) {
+        for (int c = 0; c < size; ++c) {
+            tile.at<double>(r, c) = surface.at<double>(position.y + r, position.x + c) + level + noise(engine);
+        }
+    }
+
+    return tile;
+}
+
+struct SyntheticGrid {
+    std::vector<cv::Mat> image_list;
+    std::vector<cv::Point> true_list;  // 图块左上角在高度图中的真实位置
+    std::vector<cv::Point2d> predicted_list;
+};
+
+SyntheticGrid makeGrid(const cv::Mat &surface, int grid_cols, int grid_rows, int tile_size, int step,
+                       unsigned int seed) {
+    std::mt19937 engine(seed);
+    std::uniform_int_distribution<int> jitter(-3, 3);
+    std::uniform_real_distribution<double> stage_error(-5.0, 5.0);  // 相邻图块的相对误差小于重叠宽度的一半
+    std::uniform_real_distribution<double> level(-5.0, 5.0);
+
+    SyntheticGrid grid;
+    for (int gy = 0; gy < grid_rows; ++gy) {
+        for (int gx = 0; gx < grid_cols; ++gx) {
+            cv::Point position(8 + gx * step + jitter(engine), 8 + gy * step + jitter(engine));
+            grid.true_list.push_back(position);
+            grid.predicted_list.emplace_back(position.x + stage_error(engine), position.y + stage_error(engine));
+            grid.image_list.push_back(cropTile(surface, position, tile_size, level(engine), engine));
+        }
+    }
+
+    return grid;
+}
+
+void checkKnownOffsets(const cv::Mat &surface) {
+    SyntheticGrid grid = makeGrid(surface, 4, 3, 128, 96, 2);
+
+    SpmHeightMap<double> canvas;
+    std::vector<cv::Point> placement_list;
+    bool status = SpmGridStitcher::stitch(grid.image_list, grid.predicted_list, canvas, SpmGridStitcher::Params(),
+                                          &placement_list);
+    expectTrue("stitch() known offsets", status);
+    if (!status) return;
+
+    cv::Point min_true = grid.true_list[0], max_true = grid.true_list[0];
+    for (const auto &position : grid.true_list) {
+        min_true.x = std::min(min_true.x, position.x);
+        min_true.y = std::min(min_true.y, position.y);
+        max_true.x = std::max(max_true.x, position.x);
+        max_true.y = std::max(max_true.y, position.y);
+    }
+    expectTrue("canvas size", canvas.cols() == max_true.x - min_true.x + 128 &&
+                              canvas.rows() == max_true.y - min_true.y + 128);
+    for (size_t i = 0; i < grid.true_list.size(); ++i) {
+        cv::Point expected = grid.true_list[i] - min_true;
+        expectTrue("tile " + std::to_string(i) + " placed at (" + std::to_string(expected.x) + ", " +
+                   std::to_string(expected.y) + "), got (" + std::to_string(placement_list[i].x) + ", " +
+                   std::to_string(placement_list[i].y) + ")", placement_list[i] == expected);
+    }
+
+    // 各图块的高度偏移被校正后，拼接结果（被图块覆盖的部分）与高度图只相差一个常数
+    std::vector<char> covered((size_t) canvas.rows() * canvas.cols(), 0);
+    for (const auto &position : placement_list) {
+        for (int r = position.y; r < position.y + 128; ++r) {
+            std::fill_n(covered.begin() + (std::ptrdiff_t) r * canvas.cols() + position.x, 128, 1);
+        }
+    }
+    double diff_min = HUGE_VAL, diff_max = -HUGE_VAL;
+    for (int r = 0; r < canvas.rows(); ++r) {
+        for (int c = 0; c < canvas.cols(); ++c) {
+            if (!covered[(size_t) r * canvas.cols() + c]) continue;
+
+            double diff = canvas.rowPtr(r)[c] - surface.at<double>(r + min_true.y, c + min_true.x);
+            diff_min = std::min(diff_min, diff);
+            diff_max = std::max(diff_max, diff);
+        }
+    }
+    std::cout << "canvas " << canvas.cols() << " x " << canvas.rows() << ", height difference range "
+              << diff_max - diff_min << std::endl;
+    expectTrue("canvas matches surface up to a constant", diff_max - diff_min < 0.1);
+}
+
+void checkDisconnected(const cv::Mat &surface) {
+    SyntheticGrid grid = makeGrid(surface, 3, 2, 128, 96, 3);
+
+    // 最后一个图块的位置远离其他图块，没有重叠
+    std::mt19937 engine(4);
+    cv::Point far_position(surface.cols - 128, surface.rows - 128);
+    grid.image_list.back() = cropTile(surface, far_position, 128, 0.0, engine);
+    grid.predicted_list.back() = cv::Point2d(far_position);
+
+    SpmHeightMap<double> canvas;
+    expectTrue("stitch() rejects disconnected tiles",
+               !SpmGridStitcher::stitch(grid.image_list, grid.predicted_list, canvas));
+}
+
+void checkNarrowOverlap(const cv::Mat &surface) {
+    // 预测重叠 40 像素，真实位置再向外 18 像素（重叠 22 像素），在 40 - min_overlap = 24 像素的搜索范围内
+    const struct {
+        std::string name;
+        cv::Point true_offset;
+        cv::Point2d predicted_offset;
+    } case_list[] = {
+            {"horizontal", {106, 2}, {88.0, 0.0}},
+            {"vertical",   {-3, 106}, {0.0, 88.0}},
+    };
+
+    for (const auto &test_case : case_list) {
+        std::mt19937 engine(6);
+        cv::Point origin(40, 40);
+        std::vector<cv::Mat> image_list = {cropTile(surface, origin, 128, 0.0, engine),
+                                           cropTile(surface, origin + test_case.true_offset, 128, 1.0, engine)};
+        std::vector<cv::Point2d> predicted_list = {{0.0, 0.0}, test_case.predicted_offset};
+
+        SpmHeightMap<double> canvas;
+        std::vector<cv::Point> placement_list;
+        bool status = SpmGridStitcher::stitch(image_list, predicted_list, canvas, SpmGridStitcher::Params(),
+                                              &placement_list);
+        expectTrue("stitch() narrow " + test_case.name + " overlap", status);
+        if (status) {
+            expectTrue("narrow " + test_case.name + " overlap offset",
+                       placement_list[1] - placement_list[0] == test_case.true_offset);
+        }
+    }
+}
+
+void checkCanvasArea(const cv::Mat &surface) {
+    // L 形排列的 3 个图块，画布面积约为图块面积之和的 1.08 倍
+    std::mt19937 engine(5);
+    std::vector<cv::Point> true_list = {{8, 8}, {110, 8}, {8, 110}};
+    std::vector<cv::Mat> image_list;
+    std::vector<cv::Point2d> predicted_list;
+    for (const auto &position : true_list) {
+        image_list.push_back(cropTile(surface, position, 128, 0.0, engine));
+        predicted_list.emplace_back(position.x + 4.0, position.y - 3.0);
+    }
+
+    SpmHeightMap<double> canvas;
+    expectTrue("stitch() L layout", SpmGridStitcher::stitch(image_list, predicted_list, canvas));
+
+    SpmGridStitcher::Params params;
+    params.max_canvas_area_ratio = 1.0;
+    expectTrue("stitch() rejects canvas larger than max_canvas_area_ratio",
+               !SpmGridStitcher::stitch(image_list, predicted_list, canvas, params));
+}
+
+}  // namespace
+
+
+int main() {
+    cv::Mat surface = makeSurface(520, 640, 1);
+
+    checkKnownOffsets(surface);
+    checkDisconnected(surface);
+    checkNarrowOverlap(surface);
+    checkCanvasArea(surface);
+
+    if (g_fail_count > 0) {
+        std::cout << g_fail_count << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,208 @@
+/**
+ * @brief 文件头解析一致性检查
+ *
+ * 以基线版本中的正则表达式解析 data/sample_head.txt，与 SpmAttributeSchema + SpmHeaderIndex 的解析结果逐项比较，
+ * 并检查带单位的 Scan Size / X Offset / Y Offset 的换算以及 buildOutputSpmHeader() 按原单位改写 Scan Size。
+ *
+ * 构建与运行（在仓库根目录下）:
+ *   g++ -std=c++17 -O2 -Ispm_process/include spm_process/tests/spm_parse_check.cpp -o spm_parse_check
+ *   ./spm_parse_check spm_process/tests/data/sample_head.txt
+ */
+
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+
+#include "spm_reader.hpp"
+
+
+namespace {
+
+int g_fail_count = 0;
+
+template<typename T>
+void expectEqual(const std::string &name, const T &actual, const T &expected) {
+    if (actual == expected) return;
+
+    std::cout << "[FAIL] " << name << ": " << actual << " != " << expected << std::endl;
+    ++g_fail_count;
+}
+
+// 基线版本 SpmRegexParse 的解析函数
+struct BaselineRegexParse {
+    static int getIntFromTextByRegex(const std::string &regex_string, const std::string &spm_file_text) {
+        std::regex pattern(regex_string);
+        std::smatch matches;
+        if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 2) {
+            return std::stoi(matches[1].str());
+        } else {
+            return 0;
+        }
+    }
+
+    static double getDoubleFromTextByRegex(const std::string &regex_string, const std::string &spm_file_text) {
+        std::regex pattern(regex_string);
+        std::smatch matches;
+        if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 2) {
+            return std::stod(matches[1].str());
+        } else {
+            return 0;
+        }
+    }
+
+    static std::string getStringFromTextByRegex(const std::string &regex_string, const std::string &spm_file_text) {
+        std::regex pattern(regex_string);
+        std::smatch matches;
+        if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 2) {
+            return matches[1].str();
+        } else {
+            return "";
+        }
+    }
+
+    static long long getLongLongFromTextByRegexToNM(const std::string &regex_string, const std::string &spm_file_text) {
+        std::regex pattern(regex_string);
+        std::smatch matches;
+        if (std::regex_search(spm_file_text, matches, pattern) && matches.size() >= 3) {
+            if (matches[2].str() == "nm") {
+                return std::stoll(matches[1].str());
+            } else if (matches[2].str() == "um") {
+                return (long long) (std::stod(matches[1].str()) * 1000);
+            } else if (matches[2].str() == "mm") {
+                return (long long) (std::stoll(matches[1].str()) * 1000 * 1000);
+            } else {  // error
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+    }
+};
+
+struct TextEdit : public SpmRegexParse {
+    using SpmRegexParse::replaceLengthNMFromText;
+};
+
+// 与 SpmHeaderScanner 相同，按 "\*Ciao image list" 切分 Head list 与第一个 Image list
+void splitSections(const std::string &text, std::string &head_text, std::string &image_text) {
+    const std::string image_list_str = "\\*Ciao image list";
+    size_t image_begin = text.find(image_list_str);
+    head_text = text.substr(0, image_begin);
+    image_text = image_begin == std::string::npos ? std::string() : text.substr(image_begin);
+}
+
+void checkHeadAgainstBaseline(const std::string &head_text) {
+    using Schema = SpmAttributeSchema;
+    using Baseline = BaselineRegexParse;
+    SpmHeaderIndex head_index(head_text);
+
+    expectEqual("Scan Size", Schema::get<unsigned int>(head_index, Schema::scan_size),
+                (unsigned int) Baseline::getIntFromTextByRegex(R"(\Scan Size: (\d+(\.\d+)?) nm)", head_text));
+    expectEqual("Engage X Pos", Schema::get<long long>(head_index, Schema::engage_x_pos),
+                Baseline::getLongLongFromTextByRegexToNM(R"(\\Engage X Pos: ([0-9.-]*) ([num]*))", head_text));
+    expectEqual("Engage Y Pos", Schema::get<long long>(head_index, Schema::engage_y_pos),
+                Baseline::getLongLongFromTextByRegexToNM(R"(\\Engage Y Pos: ([0-9.-]*) ([num]*))", head_text));
+    expectEqual("X Offset", Schema::get<int>(head_index, Schema::x_offset),
+                Baseline::getIntFromTextByRegex(R"(\\X Offset: ([0-9.-]*) ([num]*))", head_text));
+    expectEqual("Y Offset", Schema::get<int>(head_index, Schema::y_offset),
+                Baseline::getIntFromTextByRegex(R"(\\Y Offset: ([0-9.-]*) ([num]*))", head_text));
+}
+
+void checkImageAgainstBaseline(const std::string &image_text) {
+    using Schema = SpmAttributeSchema;
+    using Baseline = BaselineRegexParse;
+    SpmHeaderIndex image_index(image_text);
+
+    expectEqual("Data length", Schema::get<int>(image_index, Schema::data_length),
+                Baseline::getIntFromTextByRegex(R"(\Data length: (\d+))", image_text));
+    expectEqual("Data offset", Schema::get<int>(image_index, Schema::data_offset),
+                Baseline::getIntFromTextByRegex(R"(\Data offset: (\d+))", image_text));
+    expectEqual("Bytes/pixel", Schema::get<int>(image_index, Schema::bytes_per_pixel),
+                Baseline::getIntFromTextByRegex(R"(\Bytes/pixel: ([24]))", image_text));
+    expectEqual("Frame direction", Schema::get<std::string>(image_index, Schema::frame_direction),
+                Baseline::getStringFromTextByRegex(R"(\Frame direction: ([A-Za-z]+))", image_text));
+    expectEqual("Capture start line", Schema::get<int>(image_index, Schema::capture_start_line),
+                Baseline::getIntFromTextByRegex(R"(\Capture start line: (\d+))", image_text));
+    expectEqual("Color Table Index", Schema::get<int>(image_index, Schema::color_table_index),
+                Baseline::getIntFromTextByRegex(R"(\Color Table Index: (\d+))", image_text));
+    expectEqual("Relative frame time", Schema::get<double>(image_index, Schema::relative_frame_time),
+                Baseline::getDoubleFromTextByRegex(R"(\Relative frame time: (\d+(\.\d+)?))", image_text));
+    expectEqual("Samps/line", Schema::get<int>(image_index, Schema::samps_per_line),
+                Baseline::getIntFromTextByRegex(R"(\Samps/line: (\d+))", image_text));
+    expectEqual("Number of lines", Schema::get<int>(image_index, Schema::number_of_lines),
+                Baseline::getIntFromTextByRegex(R"(\Number of lines: (\d+))", image_text));
+}
+
+// 基线版本只识别 nm（Scan Size）或忽略单位（X/Y Offset），以下情况按单位换算为 nm
+void checkLengthUnits() {
+    using Schema = SpmAttributeSchema;
+    const std::string head_text = "\\*Ciao scan list\n"
+                                  "\\Scan Size: 5 ~m\n"
+                                  "\\X Offset: 1.5 um\n"
+                                  "\\Y Offset: -250 pm\n";
+    SpmHeaderIndex head_index(head_text);
+
+    expectEqual("Scan Size (~m)", Schema::get<unsigned int>(head_index, Schema::scan_size), 5000u);
+    expectEqual("X Offset (um)", Schema::get<int>(head_index, Schema::x_offset), 1500);
+    expectEqual("Y Offset (pm)", Schema::get<int>(head_index, Schema::y_offset), 0);
+}
+
+void checkScanSizeRewrite() {
+    const struct {
+        std::string line;
+        long long new_value_nm;
+        std::string expected;
+    } case_list[] = {
+            {"\\Scan Size: 5000 nm",        12345, "\\Scan Size: 12345 nm"},
+            {"\\Scan Size: 5 5 ~m",         12345, "\\Scan Size: 12.345 12.345 ~m"},
+            {"\\Scan Size: 5 5 ~m",         20000, "\\Scan Size: 20 20 ~m"},
+            {"\\Scan Size: 0.005 0.005 mm", 4500, "\\Scan Size: 0.0045 0.0045 mm"},
+    };
+
+    for (const auto &test_case : case_list) {
+        std::string line = test_case.line;
+        expectEqual("replaceLengthNMFromText() return", TextEdit::replaceLengthNMFromText(line, test_case.new_value_nm),
+                    true);
+        expectEqual("replaceLengthNMFromText()", line, test_case.expected);
+    }
+
+    std::string line = "\\Scan Size: unknown";
+    expectEqual("replaceLengthNMFromText() invalid", TextEdit::replaceLengthNMFromText(line, 1000), false);
+    expectEqual("replaceLengthNMFromText() invalid unchanged", line, std::string("\\Scan Size: unknown"));
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <sample_head.txt>" << std::endl;
+        return 2;
+    }
+
+    std::ifstream sample_file(argv[1], std::ios::binary);
+    if (!sample_file.is_open()) {
+        std::cout << "Failed to open sample header: " << argv[1] << std::endl;
+        return 2;
+    }
+    std::stringstream sample_stream;
+    sample_stream << sample_file.rdbuf();
+
+    std::string head_text, image_text;
+    splitSections(sample_stream.str(), head_text, image_text);
+
+    checkHeadAgainstBaseline(head_text);
+    checkImageAgainstBaseline(image_text);
+    checkLengthUnits();
+    checkScanSizeRewrite();
+
+    if (g_fail_count > 0) {
+        std::cout << g_fail_count << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
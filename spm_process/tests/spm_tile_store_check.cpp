@@ -0,0 +1,186 @@
+/**
+ * @brief SpmTileStore 编解码检查
+ *
+ * 1. Lossless 模式下 CV_32F / CV_64F 图块解压后与原图逐位相同，包括 NaN、±Inf、-0.0、非规格化数与 1xN / Nx1 图块
+ * 2. Quantized 模式的最大误差不超过 (max - min) / 131070
+ * 3. 可选: --bench <count> <rows> <cols> 生成模拟的拉平高度图，统计两种模式的压缩率与编解码耗时
+ *
+ * 构建与运行（在仓库根目录下，需 OpenCV）:
+ *   g++ -std=c++17 -O2 -Ispm_process/include -I<opencv include> spm_process/tests/spm_tile_store_check.cpp \
+ *       -o spm_tile_store_check -l<opencv_core> -lpthread
+ *   ./spm_tile_store_check
+ *   ./spm_tile_store_check --bench 512 512 512
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "spm_tile_store.hpp"
+
+
+namespace {
+
+int g_fail_count = 0;
+
+void expectTrue(const std::string &name, bool condition) {
+    if (condition) return;
+
+    std::cout << "[FAIL] " << name << std::endl;
+    ++g_fail_count;
+}
+
+/**
+ * @brief 模拟拉平后的高度图（单位 nm）: 倾斜残余 + 周期形貌 + 高斯噪声
+ */
+template<typename T>
+cv::Mat makeHeightTile(int rows, int cols, unsigned int seed, double noise_nm) {
+    std::mt19937 engine(seed);
+    std::normal_distribution<double> noise(0.0, noise_nm);
+    std::uniform_real_distribution<double> phase(0.0, 6.283185307179586);
+    double phase_x = phase(engine), phase_y = phase(engine);
+
+    cv::Mat image(rows, cols, sizeof(T) == sizeof(float) ? CV_32FC1 : CV_64FC1);
+    for (int r = 0; r < rows; ++r) {
+        T *line = image.ptr<T>(r);
+        for (int c = 0; c < cols; ++c) {
+            double height = 0.002 * (c - cols / 2) - 0.001 * (r - rows / 2) +
+                            12.0 * std::sin(c * 0.05 + phase_x) * std::cos(r * 0.04 + phase_y) + noise(engine);
+            line[c] = (T) height;
+        }
+    }
+
+    return image;
+}
+
+template<typename T>
+bool isBitExact(const cv::Mat &a, const cv::Mat &b) {
+    if (a.empty() || b.empty() || a.rows != b.rows || a.cols != b.cols || a.type() != b.type()) return false;
+
+    for (int r = 0; r < a.rows; ++r) {
+        if (std::memcmp(a.ptr<T>(r), b.ptr<T>(r), (size_t) a.cols * sizeof(T)) != 0) return false;
+    }
+    return true;
+}
+
+template<typename T>
+void checkLossless(const std::string &type_name) {
+    std::vector<cv::Mat> image_list;
+    image_list.push_back(makeHeightTile<T>(64, 64, 1, 0.05));
+    image_list.push_back(makeHeightTile<T>(1, 37, 2, 0.05));
+    image_list.push_back(makeHeightTile<T>(37, 1, 3, 0.05));
+    image_list.push_back(makeHeightTile<T>(1, 1, 4, 0.05));
+
+    // 特殊值与随机位模式（最坏情况，走转义编码）
+    cv::Mat special = makeHeightTile<T>(16, 16, 5, 0.05);
+    T *line = special.ptr<T>(3);
+    line[0] = std::numeric_limits<T>::quiet_NaN();
+    line[1] = -std::numeric_limits<T>::quiet_NaN();
+    line[2] = std::numeric_limits<T>::infinity();
+    line[3] = -std::numeric_limits<T>::infinity();
+    line[4] = (T) -0.0;
+    line[5] = std::numeric_limits<T>::denorm_min();
+    line[6] = -std::numeric_limits<T>::denorm_min();
+    line[7] = std::numeric_limits<T>::max();
+    line[8] = std::numeric_limits<T>::lowest();
+    std::mt19937_64 engine(6);
+    for (int c = 0; c < special.cols; ++c) {
+        uint64_t bits = engine();
+        std::memcpy(&special.ptr<T>(9)[c], &bits, sizeof(T));
+    }
+    image_list.push_back(special);
+
+    SpmTileStore tile_store;
+    expectTrue(type_name + " default mode is Lossless", tile_store.mode() == SpmTileStore::Mode::Lossless);
+    expectTrue(type_name + " putAll()", tile_store.putAll(image_list));
+
+    std::vector<cv::Mat> decoded_list = tile_store.getAll();
+    for (size_t i = 0; i < image_list.size(); ++i) {
+        expectTrue(type_name + " lossless tile " + std::to_string(i) + " bit exact",
+                   isBitExact<T>(image_list[i], decoded_list[i]));
+    }
+}
+
+template<typename T>
+void checkQuantized(const std::string &type_name) {
+    cv::Mat image = makeHeightTile<T>(64, 64, 7, 0.05);
+
+    SpmTileStore tile_store(SpmTileStore::Mode::Quantized);
+    expectTrue(type_name + " quantized put()", tile_store.put(0, image));
+    cv::Mat decoded = tile_store.get(0);
+    expectTrue(type_name + " quantized size", !decoded.empty() && decoded.rows == image.rows &&
+                                               decoded.cols == image.cols && decoded.type() == image.type());
+    if (decoded.empty()) return;
+
+    double min_value = HUGE_VAL, max_value = -HUGE_VAL, max_error = 0.0;
+    for (int r = 0; r < image.rows; ++r) {
+        for (int c = 0; c < image.cols; ++c) {
+            min_value = std::min(min_value, (double) image.ptr<T>(r)[c]);
+            max_value = std::max(max_value, (double) image.ptr<T>(r)[c]);
+            max_error = std::max(max_error, std::fabs((double) image.ptr<T>(r)[c] - decoded.ptr<T>(r)[c]));
+        }
+    }
+    double tolerance = (max_value - min_value) / 131070 * 1.001 + std::numeric_limits<T>::epsilon() * max_value;
+    expectTrue(type_name + " quantized max error", max_error <= tolerance);
+}
+
+// 逐个图块压缩 / 解压，避免同时保存全部未压缩图块
+template<typename T>
+void bench(SpmTileStore::Mode mode, int count, int rows, int cols) {
+    using Clock = std::chrono::steady_clock;
+
+    SpmTileStore tile_store(mode);
+    tile_store.resize((size_t) count);
+    double encode_ms = 0.0, decode_ms = 0.0;
+    for (int i = 0; i < count; ++i) {
+        cv::Mat image = makeHeightTile<T>(rows, cols, (unsigned int) i, 0.05);
+        auto begin = Clock::now();
+        tile_store.put((size_t) i, image);
+        encode_ms += std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+    for (int i = 0; i < count; ++i) {
+        auto begin = Clock::now();
+        cv::Mat image = tile_store.get((size_t) i);
+        decode_ms += std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    }
+
+    std::cout << (sizeof(T) == sizeof(float) ? "CV_32F " : "CV_64F ")
+              << (mode == SpmTileStore::Mode::Lossless ? "Lossless " : "Quantized") << ": "
+              << tile_store.uncompressedBytes() / (1024.0 * 1024.0) << " MiB -> "
+              << tile_store.compressedBytes() / (1024.0 * 1024.0) << " MiB ("
+              << (double) tile_store.uncompressedBytes() / tile_store.compressedBytes() << "x), encode "
+              << encode_ms / 1000.0 << " s, decode " << decode_ms / 1000.0 << " s (single thread)" << std::endl;
+}
+
+}  // namespace
+
+
+int main(int argc, char **argv) {
+    if (argc >= 5 && std::string(argv[1]) == "--bench") {
+        int count = std::atoi(argv[2]), rows = std::atoi(argv[3]), cols = std::atoi(argv[4]);
+        std::cout << count << " tiles of " << rows << "x" << cols << std::endl;
+        bench<double>(SpmTileStore::Mode::Lossless, count, rows, cols);
+        bench<double>(SpmTileStore::Mode::Quantized, count, rows, cols);
+        bench<float>(SpmTileStore::Mode::Lossless, count, rows, cols);
+        bench<float>(SpmTileStore::Mode::Quantized, count, rows, cols);
+        return 0;
+    }
+
+    checkLossless<float>("CV_32F");
+    checkLossless<double>("CV_64F");
+    checkQuantized<float>("CV_32F");
+    checkQuantized<double>("CV_64F");
+
+    if (g_fail_count > 0) {
+        std::cout << g_fail_count << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}